@@ -0,0 +1,128 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+/*
+ * Compares the pread and io_uring sampler backends on a fake sysfs tree
+ * holding the attributes read on every tick (coretemp inputs, fan inputs,
+ * battery charge and AC state).
+ *
+ *    sampler_bench [ticks] [cores]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "sampler.h"
+#include "sysfs.h"
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+void create(const boost::filesystem::path& path, const std::string& value)
+{
+   std::ofstream ofs(path.c_str());
+   ofs << value << '\n';
+}
+
+void run(const std::string& backend, const boost::ptr_vector<aird::sysfs::attribute>& attr, size_t ticks)
+{
+   aird::sysfs::sampler s(backend);
+
+   for (size_t i = 0; i < attr.size(); ++i)
+   {
+      s.add(attr[i]);
+   }
+
+   s.sample();  // open all files outside of the timed loop
+
+   size_t syscalls = 0;
+   char buf[aird::sysfs::attribute::MAX_SIZE];
+   clock_type::time_point start = clock_type::now();
+
+   for (size_t t = 0; t < ticks; ++t)
+   {
+      s.sample();
+      syscalls += s.syscalls();
+
+      for (size_t i = 0; i < attr.size(); ++i)
+      {
+         attr[i].read(buf, sizeof(buf));
+      }
+   }
+
+   double us = std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+
+   std::cout << s.backend() << ": " << double(syscalls)/ticks << " syscalls/tick, "
+             << us/ticks << " us/tick (" << attr.size() << " attributes)\n";
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   size_t ticks = argc > 1 ? std::atoi(argv[1]) : 10000;
+   size_t cores = argc > 2 ? std::atoi(argv[2]) : 4;
+
+   boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("aird-bench-%%%%%%%%");
+   boost::filesystem::create_directories(root);
+
+   boost::ptr_vector<aird::sysfs::attribute> attr;
+
+   for (size_t i = 1; i <= cores + 1; ++i)
+   {
+      boost::filesystem::path p = root / ("temp" + boost::lexical_cast<std::string>(i) + "_input");
+      create(p, "45000");
+      attr.push_back(new aird::sysfs::attribute(p));
+   }
+
+   for (size_t i = 1; i <= 2; ++i)
+   {
+      boost::filesystem::path p = root / ("fan" + boost::lexical_cast<std::string>(i) + "_input");
+      create(p, "2000");
+      attr.push_back(new aird::sysfs::attribute(p));
+   }
+
+   create(root / "charge_now", "3000000");
+   attr.push_back(new aird::sysfs::attribute(root / "charge_now"));
+   create(root / "online", "1");
+   attr.push_back(new aird::sysfs::attribute(root / "online"));
+
+   run("pread", attr, ticks);
+   run("io_uring", attr, ticks);
+
+   attr.clear();
+   boost::filesystem::remove_all(root);
+
+   return 0;
+}
@@ -0,0 +1,145 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+/*
+ * Compares the monotonic-deque window aggregators against the loop that
+ * walked back through the temperature history on every tick, for the
+ * default fan/cpu hot and cold delays at various tick intervals.
+ *
+ *    sliding_window_bench [ticks]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "sliding_window.h"
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+volatile double g_sink;
+
+// fan hot/cold and cpu hot/cold delays in milliseconds
+const unsigned DELAYS[] = { 40000, 20000, 10000, 20000 };
+
+std::vector<double> make_temps(size_t count)
+{
+   std::mt19937 gen(42);
+   std::normal_distribution<double> step(0.0, 0.3);
+   std::vector<double> temps(count);
+   double t = 50.0;
+
+   for (size_t i = 0; i < count; ++i)
+   {
+      t += step(gen);
+      temps[i] = t;
+   }
+
+   return temps;
+}
+
+double run_loop(const std::vector<double>& temps, unsigned interval)
+{
+   size_t history_size = 300000/interval;
+   std::vector<double> history(history_size);
+   unsigned delay = std::max(std::max(DELAYS[0], DELAYS[1]), std::max(DELAYS[2], DELAYS[3]));
+
+   clock_type::time_point start = clock_type::now();
+
+   for (size_t count = 1; count <= temps.size(); ++count)
+   {
+      history[count % history_size] = temps[count - 1];
+
+      if (delay/interval >= count)
+      {
+         continue;
+      }
+
+      double fan_cold = -300.0, fan_hot = 1000.0, cpu_cold = -300.0, cpu_hot = 1000.0;
+
+      for (unsigned i = 0, dt = 0; dt <= delay; ++i, dt += interval)
+      {
+         double t = history[(count - i) % history_size];
+
+         if (dt <= DELAYS[0]) fan_hot = std::min(fan_hot, t);
+         if (dt <= DELAYS[1]) fan_cold = std::max(fan_cold, t);
+         if (dt <= DELAYS[2]) cpu_hot = std::min(cpu_hot, t);
+         if (dt <= DELAYS[3]) cpu_cold = std::max(cpu_cold, t);
+      }
+
+      g_sink = fan_hot + fan_cold + cpu_hot + cpu_cold;
+   }
+
+   return std::chrono::duration<double, std::nano>(clock_type::now() - start).count()/temps.size();
+}
+
+double run_window(const std::vector<double>& temps, unsigned interval)
+{
+   aird::sliding_min<double> fan_hot(DELAYS[0]/interval + 1);
+   aird::sliding_max<double> fan_cold(DELAYS[1]/interval + 1);
+   aird::sliding_min<double> cpu_hot(DELAYS[2]/interval + 1);
+   aird::sliding_max<double> cpu_cold(DELAYS[3]/interval + 1);
+
+   clock_type::time_point start = clock_type::now();
+
+   for (size_t i = 0; i < temps.size(); ++i)
+   {
+      fan_hot.push(temps[i]);
+      fan_cold.push(temps[i]);
+      cpu_hot.push(temps[i]);
+      cpu_cold.push(temps[i]);
+
+      g_sink = fan_hot.value() + fan_cold.value() + cpu_hot.value() + cpu_cold.value();
+   }
+
+   return std::chrono::duration<double, std::nano>(clock_type::now() - start).count()/temps.size();
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   size_t ticks = argc > 1 ? std::atoi(argv[1]) : 1000000;
+   std::vector<double> temps = make_temps(ticks);
+   const unsigned intervals[] = { 1000, 250, 100 };
+
+   for (size_t i = 0; i < sizeof(intervals)/sizeof(intervals[0]); ++i)
+   {
+      double loop = run_loop(temps, intervals[i]);
+      double window = run_window(temps, intervals[i]);
+
+      std::cout << intervals[i] << " ms ticks: history loop " << loop << " ns/tick, sliding window "
+                << window << " ns/tick (" << loop/window << "x)\n";
+   }
+
+   return 0;
+}
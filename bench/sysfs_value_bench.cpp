@@ -0,0 +1,145 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+/*
+ * Compares the allocation-free sysfs value parsers against the
+ * boost::lexical_cast/std::istringstream path they replaced. Both sides
+ * start from the same raw buffer, as filled by sysfs::attribute::read().
+ */
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "sysfs_value.h"
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+const size_t ITERATIONS = 1000000;
+
+volatile double g_sink;
+
+template <typename Fun>
+double run(Fun fun)
+{
+   clock_type::time_point start = clock_type::now();
+
+   for (size_t i = 0; i < ITERATIONS; ++i)
+   {
+      g_sink = fun();
+   }
+
+   return std::chrono::duration<double, std::nano>(clock_type::now() - start).count()/ITERATIONS;
+}
+
+void report(const char *name, double legacy, double fast)
+{
+   std::cout << name << ": lexical_cast " << legacy << " ns, sysfs_value " << fast << " ns ("
+             << legacy/fast << "x)\n";
+}
+
+// keeps the compiler from constant folding the parsers
+const char *volatile g_input;
+
+const char *input(const char *buf)
+{
+   g_input = buf;
+   return g_input;
+}
+
+const char *line_end(const char *buf)
+{
+   return buf + ::strcspn(buf, "\n");
+}
+
+}
+
+int main()
+{
+   using namespace aird::sysfs;
+
+   static const char temp[] = "47000\n";
+   static const char energy[] = "6345000\n";
+   static const char flag[] = "1\n";
+   static const char light[] = "(12,34)\n";
+   static const char freqs[] = "1801000 1800000 1700000 1600000 1500000 1400000 1300000 1200000 1100000 1000000 900000 800000 \n";
+
+   report("millidegrees",
+      run([] { return 1e-3*boost::lexical_cast<double>(std::string(input(temp), line_end(temp))); }),
+      run([] { return 1e-3*value_traits<int>::parse(input(temp), line_end(temp)); }));
+
+   report("microampere-hours",
+      run([] { return 1e-6*boost::lexical_cast<double>(std::string(input(energy), line_end(energy))); }),
+      run([] { return 1e-6*value_traits<long>::parse(input(energy), line_end(energy)); }));
+
+   report("boolean",
+      run([] { return double(boost::lexical_cast<bool>(std::string(input(flag), line_end(flag)))); }),
+      run([] { return double(value_traits<bool>::parse(input(flag), line_end(flag))); }));
+
+   report("light tuple",
+      run([] {
+         std::string val(input(light), line_end(light));
+         unsigned left, right;
+         ::sscanf(val.c_str(), "(%u,%u)", &left, &right);
+         return double(left + right);
+      }),
+      run([] {
+         std::pair<unsigned, unsigned> val = value_traits< std::pair<unsigned, unsigned> >::parse(input(light), line_end(light));
+         return double(val.first + val.second);
+      }));
+
+   report("frequency list",
+      run([] {
+         unsigned freq[32], *out = freq;
+         std::istringstream iss(std::string(input(freqs), line_end(freqs)));
+         std::istream_iterator<unsigned> in(iss);
+         out = std::copy(in, std::istream_iterator<unsigned>(), out);
+         return double(out - freq);
+      }),
+      run([] {
+         unsigned freq[32], *out = freq;
+         parse_list<unsigned>(input(freqs), line_end(freqs), out);
+         return double(freq[0]);
+      }));
+
+   report("format",
+      run([] { return double(boost::lexical_cast<std::string>(unsigned(1800000 + g_sink)).size()); }),
+      run([] {
+         char buf[32];
+         return double(value_traits<unsigned>::format(unsigned(1800000 + g_sink), buf, sizeof(buf)));
+      }));
+
+   return 0;
+}
@@ -0,0 +1,146 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <boost/bind.hpp>
+
+#include "attribute_watch.h"
+
+namespace aird {
+namespace sysfs {
+
+namespace {
+
+bool is_pollable(int fd)
+{
+   int ep = ::epoll_create1(EPOLL_CLOEXEC);
+
+   if (ep < 0)
+   {
+      return false;
+   }
+
+   epoll_event ev;
+   ev.events = EPOLLPRI;
+   ev.data.fd = fd;
+
+   bool rv = ::epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) == 0;
+
+   ::close(ep);
+
+   return rv;
+}
+
+}
+
+attribute_watch::attribute_watch(boost::asio::io_service& ios, const boost::filesystem::path& path)
+   : m_attr(path)
+   , m_desc(ios)
+   , m_stopped(true)
+{
+}
+
+bool attribute_watch::start(const handler_type& handler)
+{
+   char buf[attribute::MAX_SIZE];
+   size_t len;
+   int fd;
+
+   try
+   {
+      // the initial read arms the notification
+      len = m_attr.read(buf, sizeof(buf));
+      fd = ::dup(m_attr.fd());
+   }
+   catch (const std::runtime_error&)
+   {
+      return false;
+   }
+
+   if (fd < 0 || !is_pollable(fd))
+   {
+      if (fd >= 0)
+      {
+         ::close(fd);
+      }
+
+      return false;
+   }
+
+   m_desc.assign(fd);
+   m_handler = handler;
+   m_stopped = false;
+   m_handler(buf, len);
+   wait();
+
+   return true;
+}
+
+void attribute_watch::stop()
+{
+   if (!m_stopped)
+   {
+      m_stopped = true;
+      m_desc.close();
+   }
+}
+
+void attribute_watch::wait()
+{
+   m_desc.async_wait(boost::asio::posix::stream_descriptor::wait_error,
+      boost::bind(&attribute_watch::handle_wait, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void attribute_watch::handle_wait(const boost::system::error_code& e)
+{
+   if (e || m_stopped)
+   {
+      return;
+   }
+
+   char buf[attribute::MAX_SIZE];
+   size_t len;
+
+   try
+   {
+      len = m_attr.read(buf, sizeof(buf));
+   }
+   catch (const std::runtime_error&)
+   {
+      // device went away, keep waiting in case it comes back
+      wait();
+      return;
+   }
+
+   m_handler(buf, len);
+   wait();
+}
+
+}
+}
@@ -0,0 +1,79 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_ATTRIBUTE_WATCH_H_
+#define AIRD_ATTRIBUTE_WATCH_H_
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+
+#include "sysfs.h"
+
+namespace aird {
+namespace sysfs {
+
+/*
+ * Waits for sysfs_notify() on an attribute, which the kernel signals as
+ * POLLPRI|POLLERR on a descriptor that has read the attribute before.
+ * The handler is called with the new value on every notification.
+ *
+ * start() returns false if the attribute cannot be waited on at all, in
+ * which case the caller has to keep polling it. Note that sysfs accepts
+ * the wait on every attribute, but only a few are ever notified, so this
+ * should only be used for attributes known to call sysfs_notify().
+ */
+class attribute_watch : public boost::enable_shared_from_this<attribute_watch>
+{
+public:
+   typedef boost::function<void (const char *buf, size_t len)> handler_type;
+
+   attribute_watch(boost::asio::io_service& ios, const boost::filesystem::path& path);
+
+   bool start(const handler_type& handler);
+   void stop();
+
+   boost::filesystem::path path() const
+   {
+      return m_attr.path();
+   }
+
+private:
+   void wait();
+   void handle_wait(const boost::system::error_code& e);
+
+   attribute m_attr;
+   boost::asio::posix::stream_descriptor m_desc;
+   handler_type m_handler;
+   bool m_stopped;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,359 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem/operations.hpp>
+
+#include "device_finder.h"
+
+namespace aird {
+
+namespace {
+
+const char *CACHE_MAGIC = "aird-devices 1";
+
+std::string read_name(const boost::filesystem::path& dir)
+{
+   std::ifstream in((dir / "name").c_str());
+   std::string name;
+
+   std::getline(in, name);
+
+   return in ? name : std::string();
+}
+
+bool stat_name(const boost::filesystem::path& dir, struct stat& st)
+{
+   return ::stat((dir / "name").c_str(), &st) == 0;
+}
+
+bool below(const boost::filesystem::path& base, const boost::filesystem::path& dir)
+{
+   return dir.native().compare(0, base.native().size() + 1, base.native() + "/") == 0;
+}
+
+// the daemon runs with a zero umask, so spell out the mode
+bool make_directories(const boost::filesystem::path& dir, mode_t mode)
+{
+   if (dir.empty() || ::mkdir(dir.c_str(), mode) == 0 || errno == EEXIST)
+   {
+      return true;
+   }
+
+   return errno == ENOENT && make_directories(dir.parent_path(), mode) &&
+          (::mkdir(dir.c_str(), mode) == 0 || errno == EEXIST);
+}
+
+bool write_all(int fd, const std::string& data)
+{
+   for (size_t done = 0; done < data.size(); )
+   {
+      ssize_t rv = ::write(fd, data.data() + done, data.size() - done);
+
+      if (rv < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         return false;
+      }
+
+      done += rv;
+   }
+
+   return true;
+}
+
+}
+
+device_finder::device_finder(const std::string& basepath, const std::string& classpath, const std::string& cachefile,
+                             const std::vector<std::string>& names)
+   : m_base(basepath)
+   , m_class(classpath)
+   , m_cachefile(cachefile)
+   , m_source("cache")
+{
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   if (!load_cache(names))
+   {
+      m_devices.clear();
+      m_source = "index";
+
+      scan_index(names);
+
+      if (!resolved(names))
+      {
+         m_source = "walk";
+         walk(names);
+      }
+
+      save_cache();
+   }
+
+   m_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+const boost::filesystem::path& device_finder::get(const std::string& name) const
+{
+   map_type::const_iterator it = m_devices.find(name);
+
+   if (it == m_devices.end())
+   {
+      throw std::runtime_error("cannot find device: " + name);
+   }
+
+   return it->second;
+}
+
+bool device_finder::resolved(const std::vector<std::string>& names) const
+{
+   for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it)
+   {
+      if (m_devices.find(*it) == m_devices.end())
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool device_finder::load_cache(const std::vector<std::string>& names)
+{
+   if (m_cachefile.empty())
+   {
+      return false;
+   }
+
+   std::ifstream in(m_cachefile.c_str());
+   std::string line;
+
+   if (!std::getline(in, line) || line != CACHE_MAGIC)
+   {
+      return false;
+   }
+
+   if (!std::getline(in, line) || line != m_base.native())
+   {
+      return false;
+   }
+
+   boost::system::error_code ec;
+   boost::filesystem::path base = boost::filesystem::canonical(m_base, ec);
+
+   if (ec)
+   {
+      return false;
+   }
+
+   while (std::getline(in, line))
+   {
+      std::istringstream is(line);
+      std::string name, path;
+      unsigned long long ino;
+      long long mtime;
+      struct stat st;
+
+      if (!(is >> name >> ino >> mtime) || !std::getline(is >> std::ws, path))
+      {
+         return false;
+      }
+
+      // never trust a path that leads out of the device tree
+      boost::filesystem::path dir = boost::filesystem::canonical(path, ec);
+
+      if (ec || !below(base, dir))
+      {
+         return false;
+      }
+
+      if (!stat_name(dir, st) || st.st_ino != ino || st.st_mtime != mtime || read_name(dir) != name)
+      {
+         return false;
+      }
+
+      m_devices[name] = dir;
+   }
+
+   return resolved(names);
+}
+
+void device_finder::save_cache() const
+{
+   if (m_cachefile.empty())
+   {
+      return;
+   }
+
+   boost::filesystem::path file(m_cachefile);
+   boost::filesystem::path tmp(m_cachefile + ".tmp");
+   boost::system::error_code ec;
+
+   if (!make_directories(file.parent_path(), 0755))
+   {
+      return;
+   }
+
+   std::ostringstream out;
+
+   out << CACHE_MAGIC << "\n" << m_base.native() << "\n";
+
+   for (map_type::const_iterator it = m_devices.begin(); it != m_devices.end(); ++it)
+   {
+      struct stat st;
+
+      if (stat_name(it->second, st))
+      {
+         out << it->first << " " << st.st_ino << " " << st.st_mtime << " " << it->second.native() << "\n";
+      }
+   }
+
+   const int flags = O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC;
+   int fd = ::open(tmp.c_str(), flags, 0644);
+
+   // left behind by an interrupted run; unlink() removes a symlink, not its target
+   if (fd < 0 && errno == EEXIST && ::unlink(tmp.c_str()) == 0)
+   {
+      fd = ::open(tmp.c_str(), flags, 0644);
+   }
+
+   if (fd < 0)
+   {
+      return;
+   }
+
+   bool ok = write_all(fd, out.str());
+
+   if (::close(fd) < 0 || !ok)
+   {
+      boost::filesystem::remove(tmp, ec);
+      return;
+   }
+
+   boost::filesystem::rename(tmp, file, ec);
+}
+
+void device_finder::scan_index(const std::vector<std::string>& names)
+{
+   std::set<std::string> wanted(names.begin(), names.end());
+   std::vector<boost::filesystem::path> entries;
+   boost::system::error_code ec;
+
+   for (boost::filesystem::directory_iterator it(m_class, ec); !ec && it != boost::filesystem::directory_iterator(); it.increment(ec))
+   {
+      entries.push_back(it->path());
+   }
+
+   std::sort(entries.begin(), entries.end());
+
+   boost::filesystem::path base = boost::filesystem::canonical(m_base, ec);
+
+   if (ec)
+   {
+      return;
+   }
+
+   for (std::vector<boost::filesystem::path>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+   {
+      // older drivers have the name on the parent device, which is also
+      // the directory a walk would find first
+      boost::filesystem::path dirs[] = { *it / "device", *it };
+
+      for (size_t i = 0; i < 2; ++i)
+      {
+         std::string name = read_name(dirs[i]);
+
+         if (wanted.count(name) && m_devices.find(name) == m_devices.end())
+         {
+            boost::filesystem::path dir = boost::filesystem::canonical(dirs[i], ec);
+
+            // only accept devices below the configured base path
+            if (!ec && below(base, dir))
+            {
+               m_devices[name] = dir;
+            }
+
+            break;
+         }
+      }
+   }
+}
+
+void device_finder::walk(const std::vector<std::string>& names)
+{
+   std::set<std::string> wanted(names.begin(), names.end());
+   std::deque<boost::filesystem::path> dirs;
+
+   for (map_type::const_iterator it = m_devices.begin(); it != m_devices.end(); ++it)
+   {
+      wanted.erase(it->first);
+   }
+
+   dirs.push_back(m_base);
+
+   while (!dirs.empty() && !wanted.empty())
+   {
+      boost::filesystem::path path = dirs.front();
+      dirs.pop_front();
+
+      std::string name = read_name(path);
+
+      if (wanted.erase(name))
+      {
+         m_devices[name] = path;
+      }
+
+      boost::system::error_code ec;
+
+      for (boost::filesystem::directory_iterator it(path, ec); !ec && it != boost::filesystem::directory_iterator(); it.increment(ec))
+      {
+         // symlinks in sysfs lead back up the tree
+         if (boost::filesystem::is_directory(it->symlink_status()))
+         {
+            dirs.push_back(it->path());
+         }
+      }
+   }
+}
+
+}
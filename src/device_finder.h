@@ -0,0 +1,89 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_DEVICE_FINDER_H_
+#define AIRD_DEVICE_FINDER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace aird {
+
+/*
+ * Resolves hwmon device names (as found in their "name" attribute) to
+ * sysfs directories in a single pass. The /sys/class/hwmon index is tried
+ * first; only names not found there cause a breadth-first walk of the
+ * base path, which stops as soon as all names are resolved.
+ *
+ * If a cache file is given, the resolved paths are stored along with the
+ * inode and mtime of each "name" file. On the next start, the cached
+ * entries are used if all of them still match, so the walk is skipped.
+ */
+class device_finder
+{
+public:
+   device_finder(const std::string& basepath, const std::string& classpath, const std::string& cachefile,
+                 const std::vector<std::string>& names);
+
+   // throws if the device was not found
+   const boost::filesystem::path& get(const std::string& name) const;
+
+   // how the devices were found: "cache", "index" or "walk"
+   const char *source() const
+   {
+      return m_source;
+   }
+
+   // time spent in discovery, in seconds
+   double elapsed() const
+   {
+      return m_elapsed;
+   }
+
+private:
+   typedef std::map<std::string, boost::filesystem::path> map_type;
+
+   bool load_cache(const std::vector<std::string>& names);
+   void save_cache() const;
+   void scan_index(const std::vector<std::string>& names);
+   void walk(const std::vector<std::string>& names);
+   bool resolved(const std::vector<std::string>& names) const;
+
+   const boost::filesystem::path m_base;
+   const boost::filesystem::path m_class;
+   const std::string m_cachefile;
+   map_type m_devices;
+   const char *m_source;
+   double m_elapsed;
+};
+
+}
+
+#endif
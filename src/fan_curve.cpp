@@ -0,0 +1,155 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include "fan_curve.h"
+
+namespace aird {
+
+namespace {
+
+size_t table_size(double from, double to)
+{
+   return static_cast<size_t>(std::lround((to - from)*fan_curve::STEPS_PER_DEGREE)) + 1;
+}
+
+}
+
+std::vector<fan_curve::point> fan_curve::parse(const std::string& spec)
+{
+   std::istringstream is(spec);
+   std::vector<point> points;
+   std::string item;
+
+   while (is >> item)
+   {
+      const char *beg = item.c_str();
+      char *end;
+      double temp = ::strtod(beg, &end);
+
+      if (end == beg || *end != ':')
+      {
+         throw std::runtime_error("invalid fan curve point: " + item);
+      }
+
+      beg = end + 1;
+      unsigned long rpm = ::strtoul(beg, &end, 10);
+
+      if (end == beg || *end != '\0')
+      {
+         throw std::runtime_error("invalid fan curve point: " + item);
+      }
+
+      points.push_back(point(temp, rpm));
+   }
+
+   return points;
+}
+
+fan_curve fan_curve::linear(const std::vector<point>& points, unsigned speed_min, unsigned speed_max)
+{
+   if (points.empty())
+   {
+      throw std::runtime_error("empty fan curve");
+   }
+
+   for (size_t i = 1; i < points.size(); ++i)
+   {
+      if (points[i].first <= points[i - 1].first)
+      {
+         throw std::runtime_error("fan curve temperatures must be ascending");
+      }
+   }
+
+   double base = points.front().first;
+   std::vector<unsigned> table(table_size(base, points.back().first));
+   size_t seg = 0;
+
+   for (size_t i = 0; i < table.size(); ++i)
+   {
+      double t = base + double(i)/STEPS_PER_DEGREE;
+
+      while (seg + 2 < points.size() && t >= points[seg + 1].first)
+      {
+         ++seg;
+      }
+
+      if (points.size() == 1)
+      {
+         table[i] = points.front().second;
+      }
+      else
+      {
+         const point& a = points[seg];
+         const point& b = points[seg + 1];
+         double f = std::min(std::max((t - a.first)/(b.first - a.first), 0.0), 1.0);
+
+         table[i] = static_cast<unsigned>(std::lround(a.second + f*(double(b.second) - double(a.second))));
+      }
+
+      table[i] = std::min(std::max(table[i], speed_min), speed_max);
+   }
+
+   return fan_curve(base, table);
+}
+
+fan_curve fan_curve::stepped(double temp_min, double temp_delta, unsigned speed_min, unsigned speed_delta, unsigned speed_max)
+{
+   if (temp_delta <= 0.0)
+   {
+      throw std::runtime_error("fan temperature delta must be positive");
+   }
+
+   unsigned steps = speed_delta > 0 && speed_max > speed_min ? (speed_max - speed_min + speed_delta - 1)/speed_delta : 0;
+   std::vector<unsigned> table(table_size(temp_min, temp_min + steps*temp_delta));
+
+   for (size_t i = 0; i < table.size(); ++i)
+   {
+      unsigned ix = static_cast<unsigned>(double(i)/STEPS_PER_DEGREE/temp_delta + 1e-6);
+      table[i] = std::min(speed_min + ix*speed_delta, speed_max);
+   }
+
+   return fan_curve(temp_min, table);
+}
+
+void fan_curve::dump(std::ostream& os) const
+{
+   for (size_t i = 0; i < m_table.size(); ++i)
+   {
+      char buf[32];
+      ::snprintf(buf, sizeof(buf), "%.1f", m_base + double(i)/STEPS_PER_DEGREE);
+      os << buf << " " << m_table[i] << "\n";
+   }
+}
+
+}
@@ -0,0 +1,91 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_FAN_CURVE_H_
+#define AIRD_FAN_CURVE_H_
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace aird {
+
+/*
+ * Maps temperatures to fan speeds through a table with one entry per
+ * 0.1 degrees, computed once from the curve definition, so a lookup is a
+ * single index. Temperatures between two entries use the lower entry,
+ * temperatures outside the table use the first or last entry.
+ */
+class fan_curve
+{
+public:
+   typedef std::pair<double, unsigned> point;
+
+   static const unsigned STEPS_PER_DEGREE = 10;
+
+   // parses a list of temperature:rpm points like "40:2000 60:3500 80:6000"
+   static std::vector<point> parse(const std::string& spec);
+
+   // linear interpolation between points with ascending temperatures,
+   // clamped to [speed_min, speed_max]
+   static fan_curve linear(const std::vector<point>& points, unsigned speed_min, unsigned speed_max);
+
+   // speed_min, raised by speed_delta every temp_delta above temp_min, up to speed_max
+   static fan_curve stepped(double temp_min, double temp_delta, unsigned speed_min, unsigned speed_delta, unsigned speed_max);
+
+   unsigned operator()(double temp) const
+   {
+      double x = (temp - m_base)*STEPS_PER_DEGREE + 1e-6;
+
+      if (!(x > 0.0))
+      {
+         return m_table.front();
+      }
+
+      size_t ix = static_cast<size_t>(x);
+
+      return ix < m_table.size() ? m_table[ix] : m_table.back();
+   }
+
+   // one "temperature rpm" line per table entry
+   void dump(std::ostream& os) const;
+
+private:
+   fan_curve(double base, const std::vector<unsigned>& table)
+      : m_base(base)
+      , m_table(table)
+   {
+   }
+
+   double m_base;
+   std::vector<unsigned> m_table;
+};
+
+}
+
+#endif
@@ -0,0 +1,400 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_FILTER_H_
+#define AIRD_FILTER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace aird {
+
+/*
+ * Signal filters for sensor readings. Each filter maps one input sample
+ * to one output sample and reports its latency, i.e. roughly how many
+ * samples a step in the input is delayed at the output. Filters compose
+ * statically through filter_chain, or at run time from a specification
+ * through dynamic_filter.
+ */
+
+// passes samples through unchanged
+template <typename T>
+class identity_filter
+{
+public:
+   T operator()(const T& x)
+   {
+      return x;
+   }
+
+   void reset()
+   {
+   }
+
+   double latency() const
+   {
+      return 0.0;
+   }
+};
+
+/*
+ * Median of the last n samples, which removes isolated spikes entirely
+ * as long as they are shorter than half the window. Latency is (n-1)/2
+ * samples.
+ */
+template <typename T>
+class median_filter
+{
+public:
+   explicit median_filter(size_t n)
+      : m_n(std::max<size_t>(n, 1))
+      , m_next(0)
+   {
+      m_window.reserve(m_n);
+   }
+
+   T operator()(const T& x)
+   {
+      if (m_window.size() < m_n)
+      {
+         m_window.push_back(x);
+      }
+      else
+      {
+         m_window[m_next] = x;
+         m_next = (m_next + 1) % m_n;
+      }
+
+      m_sorted = m_window;
+      typename std::vector<T>::iterator mid = m_sorted.begin() + m_sorted.size()/2;
+      std::nth_element(m_sorted.begin(), mid, m_sorted.end());
+
+      return *mid;
+   }
+
+   void reset()
+   {
+      m_window.clear();
+      m_next = 0;
+   }
+
+   double latency() const
+   {
+      return (m_n - 1)/2.0;
+   }
+
+private:
+   const size_t m_n;
+   size_t m_next;
+   std::vector<T> m_window;
+   std::vector<T> m_sorted;
+};
+
+/*
+ * Exponentially weighted moving average, y += alpha*(x - y). Latency is
+ * (1 - alpha)/alpha samples.
+ */
+template <typename T>
+class ewma_filter
+{
+public:
+   explicit ewma_filter(double alpha)
+      : m_alpha(std::min(std::max(alpha, 1e-6), 1.0))
+      , m_init(false)
+   {
+   }
+
+   T operator()(const T& x)
+   {
+      m_y = m_init ? m_y + m_alpha*(x - m_y) : x;
+      m_init = true;
+      return m_y;
+   }
+
+   void reset()
+   {
+      m_init = false;
+   }
+
+   double latency() const
+   {
+      return (1.0 - m_alpha)/m_alpha;
+   }
+
+private:
+   const double m_alpha;
+   bool m_init;
+   T m_y;
+};
+
+/*
+ * One-dimensional Kalman filter for a slowly drifting value, with process
+ * noise variance q per sample and measurement noise variance r. It
+ * converges to an EWMA with gain K = P/(P + r), where P = (q + sqrt(q^2 +
+ * 4qr))/2, so its latency is (1 - K)/K samples. A larger q/r ratio
+ * tracks faster and smooths less.
+ */
+template <typename T>
+class kalman_filter
+{
+public:
+   kalman_filter(double q, double r)
+      : m_q(std::max(q, 0.0))
+      , m_r(std::max(r, 1e-12))
+      , m_init(false)
+   {
+   }
+
+   T operator()(const T& x)
+   {
+      if (!m_init)
+      {
+         m_x = x;
+         m_p = m_r;
+         m_init = true;
+      }
+      else
+      {
+         m_p += m_q;
+         double k = m_p/(m_p + m_r);
+         m_x += k*(x - m_x);
+         m_p *= 1.0 - k;
+      }
+
+      return m_x;
+   }
+
+   void reset()
+   {
+      m_init = false;
+   }
+
+   double latency() const
+   {
+      double p = (m_q + std::sqrt(m_q*m_q + 4.0*m_q*m_r))/2.0;
+      double k = p/(p + m_r);
+      return k > 0.0 ? (1.0 - k)/k : HUGE_VAL;
+   }
+
+private:
+   const double m_q;
+   const double m_r;
+   bool m_init;
+   T m_x;
+   double m_p;
+};
+
+// applies First, then Second; latencies add up
+template <typename T, typename First, typename Second>
+class filter_chain
+{
+public:
+   filter_chain(const First& first = First(), const Second& second = Second())
+      : m_first(first)
+      , m_second(second)
+   {
+   }
+
+   T operator()(const T& x)
+   {
+      return m_second(m_first(x));
+   }
+
+   void reset()
+   {
+      m_first.reset();
+      m_second.reset();
+   }
+
+   double latency() const
+   {
+      return m_first.latency() + m_second.latency();
+   }
+
+private:
+   First m_first;
+   Second m_second;
+};
+
+/*
+ * Chain of filters configured at run time, from a specification like
+ * "median:3 ewma:0.5" or "kalman:0.01:1". An empty specification
+ * passes samples through without calling any filter. Copies share the
+ * filter state, so construct one instance per signal.
+ */
+template <typename T>
+class dynamic_filter
+{
+public:
+   explicit dynamic_filter(const std::string& spec = std::string())
+   {
+      std::istringstream is(spec);
+      std::string item;
+
+      while (is >> item)
+      {
+         std::vector<double> args;
+         std::string name = parse_item(item, args);
+
+         if (name == "median" && args.size() == 1 && args[0] >= 1.0)
+         {
+            add(median_filter<T>(static_cast<size_t>(args[0])));
+         }
+         else if (name == "ewma" && args.size() == 1 && args[0] > 0.0 && args[0] <= 1.0)
+         {
+            add(ewma_filter<T>(args[0]));
+         }
+         else if (name == "kalman" && args.size() == 2 && args[0] >= 0.0 && args[1] > 0.0)
+         {
+            add(kalman_filter<T>(args[0], args[1]));
+         }
+         else
+         {
+            throw std::runtime_error("invalid filter: " + item);
+         }
+      }
+   }
+
+   T operator()(T x)
+   {
+      for (typename stage_list::iterator it = m_stages.begin(); it != m_stages.end(); ++it)
+      {
+         x = (**it)(x);
+      }
+
+      return x;
+   }
+
+   void reset()
+   {
+      for (typename stage_list::iterator it = m_stages.begin(); it != m_stages.end(); ++it)
+      {
+         (*it)->reset();
+      }
+   }
+
+   double latency() const
+   {
+      double total = 0.0;
+
+      for (typename stage_list::const_iterator it = m_stages.begin(); it != m_stages.end(); ++it)
+      {
+         total += (*it)->latency();
+      }
+
+      return total;
+   }
+
+   bool empty() const
+   {
+      return m_stages.empty();
+   }
+
+private:
+   class stage
+   {
+   public:
+      virtual ~stage() {}
+      virtual T operator()(const T& x) = 0;
+      virtual void reset() = 0;
+      virtual double latency() const = 0;
+   };
+
+   template <typename Filter>
+   class stage_impl : public stage
+   {
+   public:
+      explicit stage_impl(const Filter& f)
+         : m_filter(f)
+      {
+      }
+
+      virtual T operator()(const T& x)
+      {
+         return m_filter(x);
+      }
+
+      virtual void reset()
+      {
+         m_filter.reset();
+      }
+
+      virtual double latency() const
+      {
+         return m_filter.latency();
+      }
+
+   private:
+      Filter m_filter;
+   };
+
+   typedef std::vector<boost::shared_ptr<stage> > stage_list;
+
+   template <typename Filter>
+   void add(const Filter& f)
+   {
+      m_stages.push_back(boost::shared_ptr<stage>(new stage_impl<Filter>(f)));
+   }
+
+   static std::string parse_item(const std::string& item, std::vector<double>& args)
+   {
+      size_t pos = item.find(':');
+      std::string name = item.substr(0, pos);
+
+      while (pos != std::string::npos)
+      {
+         size_t next = item.find(':', pos + 1);
+         std::string arg = item.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1);
+         char *end;
+         double value = ::strtod(arg.c_str(), &end);
+
+         if (arg.empty() || *end != '\0')
+         {
+            throw std::runtime_error("invalid filter: " + item);
+         }
+
+         args.push_back(value);
+         pos = next;
+      }
+
+      return name;
+   }
+
+   stage_list m_stages;
+};
+
+}
+
+#endif
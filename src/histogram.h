@@ -0,0 +1,155 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_HISTOGRAM_H_
+#define AIRD_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+namespace aird {
+
+/*
+ * Log-linear histogram: each power of two is split into 2^SubBits linear
+ * buckets, so the relative error of a quantile is below 2^-SubBits.
+ * Counters are atomic, so one thread may record while another one reads
+ * (the reader sees a slightly inconsistent, but sane view).
+ */
+template <unsigned SubBits = 2, unsigned MaxBits = 32>
+class log_linear_histogram
+{
+public:
+   static const size_t SUB_BUCKETS = size_t(1) << SubBits;
+   static const size_t BUCKETS = (MaxBits - SubBits + 1)*SUB_BUCKETS;
+   static const uint64_t MAX_VALUE = (uint64_t(1) << MaxBits) - 1;
+
+   log_linear_histogram()
+      : m_count(0)
+      , m_max(0)
+   {
+      for (size_t i = 0; i < BUCKETS; ++i)
+      {
+         m_bucket[i].store(0, std::memory_order_relaxed);
+      }
+   }
+
+   void record(uint64_t value)
+   {
+      if (value > MAX_VALUE)
+      {
+         value = MAX_VALUE;
+      }
+
+      m_bucket[index(value)].fetch_add(1, std::memory_order_relaxed);
+      m_count.fetch_add(1, std::memory_order_relaxed);
+
+      uint64_t max = m_max.load(std::memory_order_relaxed);
+
+      while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+      {
+      }
+   }
+
+   uint64_t count() const
+   {
+      return m_count.load(std::memory_order_relaxed);
+   }
+
+   uint64_t max() const
+   {
+      return m_max.load(std::memory_order_relaxed);
+   }
+
+   // upper bound of the bucket holding the q-quantile
+   uint64_t quantile(double q) const
+   {
+      uint64_t total = 0;
+      uint64_t counts[BUCKETS];
+
+      for (size_t i = 0; i < BUCKETS; ++i)
+      {
+         total += counts[i] = m_bucket[i].load(std::memory_order_relaxed);
+      }
+
+      if (total == 0)
+      {
+         return 0;
+      }
+
+      uint64_t rank = uint64_t(q*(total - 1)) + 1;
+      uint64_t seen = 0;
+
+      for (size_t i = 0; i < BUCKETS; ++i)
+      {
+         seen += counts[i];
+
+         if (seen >= rank)
+         {
+            uint64_t upper = bucket_upper(i);
+            return upper < max() ? upper : max();
+         }
+      }
+
+      return max();
+   }
+
+   static size_t index(uint64_t value)
+   {
+      if (value < SUB_BUCKETS)
+      {
+         return value;
+      }
+
+      unsigned msb = 63 - __builtin_clzll(value);
+      unsigned shift = msb - SubBits;
+
+      return ((shift + 1) << SubBits) | ((value >> shift) & (SUB_BUCKETS - 1));
+   }
+
+   static uint64_t bucket_upper(size_t ix)
+   {
+      if (ix < SUB_BUCKETS)
+      {
+         return ix;
+      }
+
+      unsigned shift = (ix >> SubBits) - 1;
+      uint64_t lower = uint64_t(SUB_BUCKETS | (ix & (SUB_BUCKETS - 1))) << shift;
+
+      return lower + (uint64_t(1) << shift) - 1;
+   }
+
+private:
+   std::atomic<uint32_t> m_bucket[BUCKETS];
+   std::atomic<uint64_t> m_count;
+   std::atomic<uint64_t> m_max;
+};
+
+}
+
+#endif
@@ -0,0 +1,257 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem/path.hpp>
+
+#include "history_file.h"
+
+namespace aird {
+
+namespace {
+
+const char MAGIC[8] = { 'a', 'i', 'r', 'd', 'h', 'i', 's', 't' };
+
+std::string read_boot_id()
+{
+   std::ifstream in("/proc/sys/kernel/random/boot_id");
+   std::string id;
+   std::getline(in, id);
+   return id;
+}
+
+bool make_directories(const boost::filesystem::path& dir, mode_t mode)
+{
+   if (dir.empty() || ::mkdir(dir.c_str(), mode) == 0 || errno == EEXIST)
+   {
+      return true;
+   }
+
+   return errno == ENOENT && make_directories(dir.parent_path(), mode) &&
+          (::mkdir(dir.c_str(), mode) == 0 || errno == EEXIST);
+}
+
+}
+
+history_file::history_file(const std::string& path, size_t capacity, const std::vector<std::string>& channels)
+   : m_path(path)
+   , m_capacity(capacity)
+   , m_channels(channels.size())
+   , m_size(sizeof(header) + m_channels*NAME_SIZE + m_capacity*sizeof(int64_t) + m_channels*m_capacity*sizeof(double))
+   , m_boot_id(read_boot_id().substr(0, sizeof(header().boot_id) - 1))
+   , m_fd(-1)
+   , m_map(0)
+   , m_reattached(false)
+{
+   // explicit mode, the daemon runs with a zero umask
+   make_directories(boost::filesystem::path(path).parent_path(), 0755);
+
+   m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+
+   if (m_fd < 0)
+   {
+      throw std::runtime_error("cannot open history file: " + path + " (" + ::strerror(errno) + ")");
+   }
+
+   struct stat st;
+
+   if (::fstat(m_fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_uid != ::geteuid())
+   {
+      ::close(m_fd);
+      throw std::runtime_error("refusing to use history file: " + path + " (not a regular file owned by us)");
+   }
+
+   bool keep = size_t(st.st_size) == m_size;
+
+   if (!keep && (::ftruncate(m_fd, 0) < 0 || ::ftruncate(m_fd, m_size) < 0))
+   {
+      int err = errno;
+      ::close(m_fd);
+      throw std::runtime_error("cannot resize history file: " + path + " (" + ::strerror(err) + ")");
+   }
+
+   void *map = ::mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+   if (map == MAP_FAILED)
+   {
+      int err = errno;
+      ::close(m_fd);
+      throw std::runtime_error("cannot map history file: " + path + " (" + ::strerror(err) + ")");
+   }
+
+   m_map = static_cast<char *>(map);
+
+   if (keep && matches(channels))
+   {
+      m_reattached = true;
+   }
+   else
+   {
+      init(channels);
+   }
+}
+
+history_file::~history_file()
+{
+   ::munmap(m_map, m_size);
+   ::close(m_fd);
+}
+
+bool history_file::matches(const std::vector<std::string>& channels) const
+{
+   const header& h = *reinterpret_cast<const header *>(m_map);
+
+   if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION || h.header_size != sizeof(header) ||
+       h.capacity != m_capacity || h.channels != m_channels || h.sequence % 2 != 0 ||
+       h.head >= m_capacity || h.size > m_capacity || m_boot_id.empty() ||
+       std::strncmp(h.boot_id, m_boot_id.c_str(), sizeof(h.boot_id)) != 0)
+   {
+      return false;
+   }
+
+   const char *names = m_map + sizeof(header);
+
+   for (size_t i = 0; i < m_channels; ++i)
+   {
+      if (std::strncmp(names + i*NAME_SIZE, channels[i].c_str(), NAME_SIZE) != 0)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+void history_file::init(const std::vector<std::string>& channels)
+{
+   std::memset(m_map, 0, m_size);
+
+   header& h = *reinterpret_cast<header *>(m_map);
+
+   std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+   h.version = VERSION;
+   h.header_size = sizeof(header);
+   h.capacity = m_capacity;
+   h.channels = m_channels;
+   std::strncpy(h.boot_id, m_boot_id.c_str(), sizeof(h.boot_id) - 1);
+
+   char *names = m_map + sizeof(header);
+
+   for (size_t i = 0; i < m_channels; ++i)
+   {
+      std::strncpy(names + i*NAME_SIZE, channels[i].c_str(), NAME_SIZE - 1);
+   }
+}
+
+int64_t *history_file::times() const
+{
+   return reinterpret_cast<int64_t *>(m_map + sizeof(header) + m_channels*NAME_SIZE);
+}
+
+double *history_file::values(size_t channel) const
+{
+   return reinterpret_cast<double *>(times() + m_capacity) + channel*m_capacity;
+}
+
+void history_file::load(series_type& series, series_type::clock::duration max_age) const
+{
+   const header& h = *reinterpret_cast<const header *>(m_map);
+   series_type::time_point oldest = series_type::clock::now() - max_age;
+   std::vector<double> v(m_channels);
+
+   if (!m_reattached || series.channels() != m_channels)
+   {
+      return;
+   }
+
+   for (size_t i = 0; i < h.size; ++i)
+   {
+      size_t slot = (h.head + i) % m_capacity;
+      series_type::time_point t(std::chrono::nanoseconds(times()[slot]));
+
+      if (t < oldest)
+      {
+         continue;
+      }
+
+      for (size_t c = 0; c < m_channels; ++c)
+      {
+         v[c] = values(c)[slot];
+      }
+
+      series.push(t, v.begin());
+   }
+}
+
+void history_file::append(const series_type& series)
+{
+   if (series.empty() || series.channels() != m_channels)
+   {
+      return;
+   }
+
+   header& h = *reinterpret_cast<header *>(m_map);
+   size_t last = series.size() - 1;
+   size_t slot;
+
+   ++h.sequence;
+   std::atomic_thread_fence(std::memory_order_release);
+
+   if (h.size < m_capacity)
+   {
+      slot = (h.head + h.size) % m_capacity;
+      ++h.size;
+   }
+   else
+   {
+      slot = h.head;
+      h.head = (h.head + 1) % m_capacity;
+   }
+
+   times()[slot] = std::chrono::duration_cast<std::chrono::nanoseconds>(series.time(last).time_since_epoch()).count();
+
+   for (size_t c = 0; c < m_channels; ++c)
+   {
+      values(c)[slot] = series.value(c, last);
+   }
+
+   std::atomic_thread_fence(std::memory_order_release);
+   ++h.sequence;
+}
+
+}
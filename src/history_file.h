@@ -0,0 +1,115 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_HISTORY_FILE_H_
+#define AIRD_HISTORY_FILE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "time_series.h"
+
+namespace aird {
+
+/*
+ * Memory-mapped copy of the sensor history, so a restarted daemon can
+ * pick up where the previous one left off and external tools can read
+ * recent samples without talking to the daemon.
+ *
+ * The file starts with a header, followed by one NUL-padded name of
+ * NAME_SIZE bytes per channel, the sample timestamps (int64_t, CLOCK_BOOTTIME
+ * nanoseconds) and one array of doubles per channel, each with room for
+ * capacity samples. The oldest sample is at slot head, there are size
+ * samples in total. The sequence number is odd while a sample is being
+ * written; readers should retry if it is odd or changes while reading.
+ *
+ * Timestamps are only meaningful during the boot they were taken in, so
+ * the file is discarded if the boot id doesn't match.
+ */
+class history_file
+{
+public:
+   typedef time_series<double> series_type;
+
+   static const uint32_t VERSION = 1;
+   static const size_t NAME_SIZE = 32;
+
+   struct header
+   {
+      char magic[8];
+      uint32_t version;
+      uint32_t header_size;
+      uint32_t capacity;
+      uint32_t channels;
+      char boot_id[40];
+      uint64_t sequence;
+      uint64_t head;
+      uint64_t size;
+   };
+
+   // creates the file if it doesn't exist or doesn't match
+   history_file(const std::string& path, size_t capacity, const std::vector<std::string>& channels);
+   ~history_file();
+
+   // whether existing samples were found
+   bool reattached() const
+   {
+      return m_reattached;
+   }
+
+   // copies samples not older than max_age into series
+   void load(series_type& series, series_type::clock::duration max_age) const;
+
+   // stores the newest sample of series
+   void append(const series_type& series);
+
+private:
+   history_file(const history_file&);
+   history_file& operator=(const history_file&);
+
+   bool matches(const std::vector<std::string>& channels) const;
+   void init(const std::vector<std::string>& channels);
+   int64_t *times() const;
+   double *values(size_t channel) const;
+
+   const std::string m_path;
+   const size_t m_capacity;
+   const size_t m_channels;
+   const size_t m_size;
+   std::string m_boot_id;
+   int m_fd;
+   char *m_map;
+   bool m_reattached;
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <algorithm>
+
+#include "io_pool.h"
+
+namespace aird {
+
+io_pool::io_pool(boost::asio::io_service& ios, size_t threads)
+   : m_ios(ios)
+   , m_work(new boost::asio::io_service::work(m_pool_ios))
+{
+   // without a worker, posted operations would never run
+   for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i)
+   {
+      m_threads.push_back(std::thread(&io_pool::worker, this));
+   }
+}
+
+io_pool::~io_pool()
+{
+   stop();
+}
+
+void io_pool::stop()
+{
+   // let operations that are already queued finish, then join
+   m_work.reset();
+
+   for (std::vector<std::thread>::iterator it = m_threads.begin(); it != m_threads.end(); ++it)
+   {
+      if (it->joinable())
+      {
+         it->join();
+      }
+   }
+
+   m_threads.clear();
+}
+
+void io_pool::worker()
+{
+   m_pool_ios.run();
+}
+
+}
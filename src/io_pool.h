@@ -0,0 +1,94 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_IO_POOL_H_
+#define AIRD_IO_POOL_H_
+
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace aird {
+
+/*
+ * A small pool of threads for blocking (sysfs) I/O. Operations are run
+ * on one of the pool threads and their completion handlers are posted
+ * back to the owner's io_service, so handlers never run concurrently
+ * with other handlers of that io_service.
+ *
+ * The handler is called as handler(std::exception_ptr error, Result r),
+ * where error is set if the operation threw.
+ */
+class io_pool
+{
+public:
+   io_pool(boost::asio::io_service& ios, size_t threads);
+   ~io_pool();
+
+   template <typename Result>
+   void async(const boost::function<Result ()>& op, const boost::function<void (std::exception_ptr, Result)>& handler)
+   {
+      m_pool_ios.post(boost::bind(&io_pool::run<Result>, this, op, handler));
+   }
+
+   void stop();
+
+private:
+   void worker();
+
+   template <typename Result>
+   void run(const boost::function<Result ()>& op, const boost::function<void (std::exception_ptr, Result)>& handler)
+   {
+      Result result = Result();
+      std::exception_ptr error;
+
+      try
+      {
+         result = op();
+      }
+      catch (...)
+      {
+         error = std::current_exception();
+      }
+
+      m_ios.post(boost::bind(handler, error, result));
+   }
+
+   boost::asio::io_service& m_ios;
+   boost::asio::io_service m_pool_ios;
+   boost::scoped_ptr<boost::asio::io_service::work> m_work;
+   std::vector<std::thread> m_threads;
+};
+
+}
+
+#endif
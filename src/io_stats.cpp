@@ -0,0 +1,85 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <map>
+#include <mutex>
+
+#include "io_stats.h"
+
+namespace aird {
+namespace sysfs {
+
+namespace {
+
+std::mutex g_mutex;
+std::map<std::string, boost::shared_ptr<io_stats> > g_registry;
+std::atomic<uint64_t> g_budget(0);
+
+}
+
+boost::shared_ptr<io_stats> io_stats::get(const std::string& name)
+{
+   std::lock_guard<std::mutex> lock(g_mutex);
+   boost::shared_ptr<io_stats>& stats = g_registry[name];
+
+   if (!stats)
+   {
+      stats.reset(new io_stats);
+   }
+
+   return stats;
+}
+
+void io_stats::list(list_type& out)
+{
+   std::lock_guard<std::mutex> lock(g_mutex);
+
+   out.assign(g_registry.begin(), g_registry.end());
+}
+
+void io_stats::set_budget(uint64_t ns)
+{
+   g_budget.store(ns, std::memory_order_relaxed);
+}
+
+uint64_t io_stats::budget()
+{
+   return g_budget.load(std::memory_order_relaxed);
+}
+
+void io_stats::check(uint64_t ns)
+{
+   uint64_t limit = budget();
+
+   if (limit > 0 && ns > limit)
+   {
+      m_over_budget.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+}
+}
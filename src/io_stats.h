@@ -0,0 +1,115 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_IO_STATS_H_
+#define AIRD_IO_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include "histogram.h"
+
+namespace aird {
+namespace sysfs {
+
+/*
+ * Latency statistics for a single sysfs attribute. All attributes with
+ * the same path share one instance, which is looked up in a global
+ * registry when the attribute is created. Recording is lock-free and
+ * may happen on any thread.
+ */
+class io_stats
+{
+public:
+   typedef log_linear_histogram<> histogram;
+   typedef std::chrono::steady_clock clock;
+   typedef std::vector<std::pair<std::string, boost::shared_ptr<const io_stats> > > list_type;
+
+   io_stats()
+      : m_over_budget(0)
+   {
+   }
+
+   static uint64_t elapsed(clock::time_point start)
+   {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+   }
+
+   void record_read(uint64_t ns)
+   {
+      m_reads.record(ns);
+      check(ns);
+   }
+
+   void record_write(uint64_t ns)
+   {
+      m_writes.record(ns);
+      check(ns);
+   }
+
+   const histogram& reads() const
+   {
+      return m_reads;
+   }
+
+   const histogram& writes() const
+   {
+      return m_writes;
+   }
+
+   // number of accesses that took longer than budget()
+   uint64_t over_budget() const
+   {
+      return m_over_budget.load(std::memory_order_relaxed);
+   }
+
+   static boost::shared_ptr<io_stats> get(const std::string& name);
+   static void list(list_type& out);
+
+   // budget in nanoseconds, 0 disables the check
+   static void set_budget(uint64_t ns);
+   static uint64_t budget();
+
+private:
+   void check(uint64_t ns);
+
+   histogram m_reads;
+   histogram m_writes;
+   std::atomic<uint64_t> m_over_budget;
+};
+
+}
+}
+
+#endif
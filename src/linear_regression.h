@@ -0,0 +1,145 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_LINEAR_REGRESSION_H_
+#define AIRD_LINEAR_REGRESSION_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace aird {
+
+/*
+ * Ordinary least-squares fit of y = a + b*x, maintained from running
+ * sums so points can be added and removed in O(1). The sums are taken
+ * relative to the first point added while empty, which keeps them small
+ * and avoids cancellation when x is a large timestamp.
+ */
+class linear_regression
+{
+public:
+   linear_regression()
+   {
+      clear();
+   }
+
+   void clear()
+   {
+      m_n = 0;
+      m_x0 = m_y0 = 0.0;
+      m_sx = m_sy = m_sxx = m_sxy = m_syy = 0.0;
+   }
+
+   void add(double x, double y)
+   {
+      if (m_n == 0)
+      {
+         clear();
+         m_x0 = x;
+         m_y0 = y;
+      }
+
+      update(x - m_x0, y - m_y0, 1.0);
+      ++m_n;
+   }
+
+   // the point must have been added before
+   void remove(double x, double y)
+   {
+      update(x - m_x0, y - m_y0, -1.0);
+      --m_n;
+   }
+
+   size_t size() const
+   {
+      return m_n;
+   }
+
+   // needs at least two distinct x values
+   double slope() const
+   {
+      return sxy()/sxx();
+   }
+
+   double intercept() const
+   {
+      return m_y0 + (m_sy - slope()*m_sx)/m_n - slope()*m_x0;
+   }
+
+   // coefficient of determination, 1 for a perfect fit, 0 if y is flat
+   double r2() const
+   {
+      double syy = this->syy();
+      return syy > 0.0 ? sxy()*sxy()/(sxx()*syy) : 0.0;
+   }
+
+   // standard error of the slope, needs at least three points
+   double slope_error() const
+   {
+      double sse = std::max(syy() - sxy()*sxy()/sxx(), 0.0);
+      return std::sqrt(sse/(m_n - 2)/sxx());
+   }
+
+private:
+   void update(double x, double y, double sign)
+   {
+      m_sx += sign*x;
+      m_sy += sign*y;
+      m_sxx += sign*x*x;
+      m_sxy += sign*x*y;
+      m_syy += sign*y*y;
+   }
+
+   double sxx() const
+   {
+      return m_sxx - m_sx*m_sx/m_n;
+   }
+
+   double sxy() const
+   {
+      return m_sxy - m_sx*m_sy/m_n;
+   }
+
+   double syy() const
+   {
+      return m_syy - m_sy*m_sy/m_n;
+   }
+
+   size_t m_n;
+   double m_x0;
+   double m_y0;
+   double m_sx;
+   double m_sy;
+   double m_sxx;
+   double m_sxy;
+   double m_syy;
+};
+
+}
+
+#endif
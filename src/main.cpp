@@ -237,6 +237,7 @@ int main(int argc, const char **argv)
       namespace po = boost::program_options;
       std::string config, pidfile;
       bool debug = false;
+      bool dump_fan_curve = false;
 
       boost::filesystem::path command(argv[0]);
 
@@ -246,6 +247,7 @@ int main(int argc, const char **argv)
          ("config,c", po::value<std::string>(&config)->default_value("/etc/aird.cfg"), "configuration file")
          ("pidfile", po::value<std::string>(&pidfile)->default_value("/var/run/aird.pid"), "pid file location")
          ("debug,d", po::value<bool>(&debug)->zero_tokens(), "run in foreground")
+         ("dump-fan-curve", po::value<bool>(&dump_fan_curve)->zero_tokens(), "print the compiled fan curves and exit")
          ;
 
       try
@@ -261,6 +263,13 @@ int main(int argc, const char **argv)
       }
 
       aird::settings set(config);
+
+      if (dump_fan_curve)
+      {
+         set.mon.dump_fan_curves(std::cout);
+         return 0;
+      }
+
       aird::daemon daemon(set, pidfile);
 
       return daemon.run(command.filename().native(), debug);
@@ -25,167 +25,294 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 ***********************************************************************/
 
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
 #include <deque>
-#include <fstream>
+#include <iomanip>
 #include <sstream>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include <unistd.h>
+#include <sys/prctl.h>
 #include <fcntl.h>
 #include <linux/input.h>
 
+#include <boost/asio/steady_timer.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "attribute_watch.h"
+#include "device_finder.h"
+#include "fan_curve.h"
+#include "filter.h"
+#include "history_file.h"
+#include "linear_regression.h"
+#include "rollup.h"
 #include "event_handler.h"
+#include "io_pool.h"
+#include "io_stats.h"
 #include "log.h"
 #include "monitor.h"
+#include "power_supply_watcher.h"
+#include "sampler.h"
+#include "sliding_window.h"
 #include "server.h"
+#include "sysfs.h"
+#include "sysfs_value.h"
+#include "time_series.h"
 
 namespace aird {
 
 namespace {
 
+const std::chrono::minutes HISTORY_LENGTH(5);
+
+// channels of the history, followed by one channel per core temperature,
+// per fan and per cpu
+enum history_channel
+{
+   MAX_TEMP,
+   ENERGY_NOW,
+   POWER_NOW,
+   DISPLAY_BACKLIGHT,
+   KEYBOARD_BACKLIGHT,
+   AMBIENT_LIGHT,
+   FIXED_CHANNELS
+};
+
 class object
 {
 public:
    object(const boost::filesystem::path& path)
-      : m_path(path)
+      : m_attr(path)
+   {
+   }
+
+   object(const boost::shared_ptr<sysfs::directory>& dir, const char *name)
+      : m_attr(dir, name)
    {
    }
 
    template <typename T>
    T get() const
    {
-      std::string tmp;
-      readline(tmp);
-      return boost::lexical_cast<T>(tmp);
+      char buf[sysfs::attribute::MAX_SIZE];
+      size_t len = readline(buf, sizeof(buf));
+      return sysfs::value_traits<T>::parse(buf, buf + len);
+   }
+
+   template <typename T, typename OutputIterator>
+   void get_list(OutputIterator out) const
+   {
+      char buf[sysfs::attribute::MAX_SIZE];
+      size_t len = readline(buf, sizeof(buf));
+      sysfs::parse_list<T>(buf, buf + len, out);
    }
 
    template <typename T>
    void set(const T& value) const
    {
-      writeline(boost::lexical_cast<std::string>(value));
+      char buf[64];
+      size_t len = sysfs::value_traits<T>::format(value, buf, sizeof(buf) - 1);
+      buf[len++] = '\n';
+      m_attr.write(buf, len);
    }
 
    bool exists() const
    {
-      return boost::filesystem::exists(m_path);
+      return m_attr.exists();
    }
 
-   const boost::filesystem::path& path() const
+   boost::filesystem::path path() const
+   {
+      return m_attr.path();
+   }
+
+   const sysfs::attribute& attribute() const
    {
-      return m_path;
+      return m_attr;
    }
 
 private:
-   void readline(std::string& line) const
+   size_t readline(char *buf, size_t size) const
+   {
+      size_t len = m_attr.read(buf, size);
+      const char *eol = static_cast<const char *>(::memchr(buf, '\n', len));
+      return eol ? eol - buf : len;
+   }
+
+   sysfs::attribute m_attr;
+};
+
+/*
+ * A writable attribute that remembers the last value committed to the
+ * hardware. Values are staged with set() and only written in commit() if
+ * they differ from what we know is there. The cached value is re-read
+ * from the hardware only if commit() is asked to verify it.
+ */
+template <typename T>
+class actuator
+{
+public:
+   actuator(const boost::shared_ptr<sysfs::directory>& dir, const char *name)
+      : m_obj(dir, name)
+      , m_current()
+      , m_desired()
+      , m_valid(false)
+      , m_pending(false)
+   {
+   }
+
+   T read() const
    {
-      std::ifstream ifs(m_path.c_str());
+      return m_obj.get<T>();
+   }
 
-      if (!ifs)
+   // filled on first use, then only updated by writes and verifying commits
+   T current() const
+   {
+      if (!m_valid)
       {
-         throw std::runtime_error("cannot open file: " + m_path.native());
+         m_current = read();
+         m_valid = true;
       }
 
-      std::getline(ifs, line);
+      return m_current;
+   }
+
+   void set(const T& value)
+   {
+      m_desired = value;
+      m_pending = true;
    }
 
-   void writeline(const std::string& line) const
+   bool commit(bool verify)
    {
-      std::ofstream ofs(m_path.c_str());
+      // refresh the cache in case someone else changed the value
+      if (verify)
+      {
+         m_valid = false;
+      }
+
+      current();
 
-      if (!ofs)
+      if (!m_pending)
       {
-         throw std::runtime_error("cannot open file: " + m_path.native());
+         return false;
       }
 
-      ofs << line << '\n';
+      m_pending = false;
+
+      if (m_current == m_desired)
+      {
+         return false;
+      }
+
+      m_valid = false;
+      m_obj.set(m_desired);
+      m_current = m_desired;
+      m_valid = true;
+
+      return true;
+   }
+
+   boost::filesystem::path path() const
+   {
+      return m_obj.path();
    }
 
-   boost::filesystem::path m_path;
+private:
+   object m_obj;
+   mutable T m_current;
+   T m_desired;
+   mutable bool m_valid;
+   bool m_pending;
 };
 
+// all devices are looked up in a single discovery pass
+std::vector<std::string> hwmon_devices()
+{
+   std::vector<std::string> names;
+   names.push_back("coretemp");
+   names.push_back("applesmc");
+   return names;
+}
+
 class device
 {
 public:
-   device(const std::string& basepath, const std::string& name)
+   device(const device_finder& finder, const std::string& name)
+      : m_dir(sysfs::directory::get(finder.get(name)))
    {
-      std::deque<boost::filesystem::path> dirs;
-      dirs.emplace_back(basepath);
+   }
 
-      while (!dirs.empty())
-      {
-         auto path = dirs.front();
-         dirs.pop_front();
+   const boost::shared_ptr<sysfs::directory>& dir() const
+   {
+      return m_dir;
+   }
 
-         try
-         {
-            if (object(path / "name").get<std::string>() == name)
-            {
-               m_path = path;
-               return;
-            }
-         }
-         catch (...)
-         {
-         }
+   const boost::filesystem::path& path() const
+   {
+      return m_dir->path();
+   }
 
-         try
-         {
-            for (boost::filesystem::directory_iterator it(path); it != boost::filesystem::directory_iterator(); ++it)
-            {
-               dirs.emplace_back(*it);
-            }
-         }
-         catch (...)
-         {
-         }
-      }
+private:
+   boost::shared_ptr<sysfs::directory> m_dir;
+};
 
-      throw std::runtime_error("cannot find device: " + name);
+// formats indexed attribute names like "temp3_input"
+class attribute_name
+{
+public:
+   attribute_name(const char *prefix, size_t index, const char *suffix)
+   {
+      ::snprintf(m_buf, sizeof(m_buf), "%s%zu_%s", prefix, index, suffix);
    }
 
-   const boost::filesystem::path& path() const
+   operator const char *() const
    {
-      return m_path;
+      return m_buf;
    }
 
 private:
-   boost::filesystem::path m_path;
+   char m_buf[32];
 };
 
 class temp
 {
 public:
-   static void get_object_range(const boost::filesystem::path& path, size_t& beg, size_t& end)
+   static void get_object_range(const boost::shared_ptr<sysfs::directory>& dir, size_t& beg, size_t& end)
    {
       beg = end = 1;
 
-      while (object(path / ("temp" + boost::lexical_cast<std::string>(end) + "_label")).exists())
+      while (object(dir, attribute_name("temp", end, "label")).exists())
       {
          ++end;
       }
    }
 
-   temp(const boost::filesystem::path& path, size_t index)
-      : m_crit(path / ("temp" + boost::lexical_cast<std::string>(index) + "_crit"))
-      , m_input(path / ("temp" + boost::lexical_cast<std::string>(index) + "_input"))
-      , m_label(path / ("temp" + boost::lexical_cast<std::string>(index) + "_label"))
-      , m_max(path / ("temp" + boost::lexical_cast<std::string>(index) + "_max"))
+   temp(const boost::shared_ptr<sysfs::directory>& dir, size_t index)
+      : m_crit(dir, attribute_name("temp", index, "crit"))
+      , m_input(dir, attribute_name("temp", index, "input"))
+      , m_label(dir, attribute_name("temp", index, "label"))
+      , m_max(dir, attribute_name("temp", index, "max"))
    {
    }
 
    double crit() const
    {
-      return 1e-3*m_crit.get<double>();
+      return 1e-3*m_crit.get<int>();
    }
 
    double input() const
    {
-      return 1e-3*m_input.get<double>();
+      return 1e-3*m_input.get<int>();
    }
 
    std::string label() const
@@ -195,7 +322,12 @@ public:
 
    double max() const
    {
-      return 1e-3*m_max.get<double>();
+      return 1e-3*m_max.get<int>();
+   }
+
+   void add_samples(sysfs::sampler& s, unsigned group) const
+   {
+      s.add(m_input.attribute(), group);
    }
 
 private:
@@ -210,16 +342,16 @@ class coretemp
 public:
    typedef std::vector<temp>::const_iterator const_iterator;
 
-   coretemp(const std::string& basepath)
-      : m_dev(basepath, "coretemp")
+   coretemp(const device_finder& finder)
+      : m_dev(finder, "coretemp")
    {
       size_t beg, end;
 
-      temp::get_object_range(m_dev.path(), beg, end);
+      temp::get_object_range(m_dev.dir(), beg, end);
 
       while (beg != end)
       {
-         m_temp.push_back(temp(m_dev.path(), beg++));
+         m_temp.push_back(temp(m_dev.dir(), beg++));
       }
    }
 
@@ -233,62 +365,201 @@ public:
       return m_temp.end();
    }
 
-   void dump(std::ostream& os) const
+   void add_samples(sysfs::sampler& s, unsigned group) const
    {
       for (const_iterator it = begin(); it != end(); ++it)
       {
-         os << it->label() << ": " << it->input() << "°C (max: " << it->max() << "°C, crit: " << it->crit() << "°C)\n";
+         it->add_samples(s, group);
       }
    }
 
-   double current_max_temp() const
+   const boost::filesystem::path& path() const
    {
-      double cur = -300.0;
+      return m_dev.path();
+   }
 
-      for (const_iterator it = begin(); it != end(); ++it)
+private:
+   device m_dev;
+   std::vector<temp> m_temp;
+};
+
+/*
+ * Tracks the maximum core temperature without reading every sensor on
+ * every tick. Between full scans only one sensor is read: the package
+ * sensor if there is one, otherwise the core that was hottest in the
+ * last scan. The maximum is extrapolated from the offset between that
+ * sensor and the real maximum at the last scan. A full scan happens
+ * every scan_interval ticks, or right away if the tracked sensor moved
+ * by more than rescan_delta since the last scan.
+ */
+class coretemp_sampler
+{
+public:
+   struct stats
+   {
+      size_t sensors;
+      size_t ticks;
+      size_t reads;
+      size_t scans;
+      size_t triggered_scans;
+      double error_sum;
+      double error_max;
+
+      void dump(std::ostream& os) const
       {
-         cur = std::max(cur, it->input());
+         os << "Coretemp sampling: " << (ticks ? double(reads)/ticks : 0.0) << " reads/tick (of " << sensors << "), "
+            << scans << " full scans (" << triggered_scans << " triggered), max-temp error avg "
+            << (scans > 1 ? error_sum/(scans - 1) : 0.0) << "°C, max " << error_max << "°C\n";
+      }
+   };
+
+   coretemp_sampler(const coretemp& ct, unsigned scan_interval, double rescan_delta)
+      : m_coretemp(ct)
+      , m_scan_interval(std::max(1u, scan_interval))
+      , m_rescan_delta(rescan_delta)
+      , m_package(-1)
+      , m_tracked(0)
+      , m_offset(0.0)
+      , m_last_scan(0.0)
+      , m_since_scan(0)
+      , m_values(ct.end() - ct.begin())
+   {
+      for (coretemp::const_iterator it = ct.begin(); it != ct.end() && m_package < 0; ++it)
+      {
+         std::string label = it->label();
+
+         if (label.compare(0, 10, "Package id") == 0 || label.compare(0, 11, "Physical id") == 0)
+         {
+            m_package = it - ct.begin();
+         }
       }
 
-      return cur;
+      m_stats.sensors = m_values.size();
+      m_stats.ticks = 0;
+      m_stats.reads = 0;
+      m_stats.scans = 0;
+      m_stats.triggered_scans = 0;
+      m_stats.error_sum = 0.0;
+      m_stats.error_max = 0.0;
    }
 
-   const boost::filesystem::path& path() const
+   // true if the sampler reads individual sensors, rather than all of them
+   bool adaptive() const
    {
-      return m_dev.path();
+      return m_scan_interval > 1;
+   }
+
+   // returns the (estimated) maximum, values of sensors not read this
+   // tick are those of the last full scan
+   double sample()
+   {
+      ++m_stats.ticks;
+
+      if (m_values.empty())
+      {
+         return -300.0;
+      }
+
+      if (m_stats.scans > 0 && ++m_since_scan < m_scan_interval)
+      {
+         double t = (m_coretemp.begin() + m_tracked)->input();
+         ++m_stats.reads;
+
+         if (std::abs(t - m_last_scan) <= m_rescan_delta)
+         {
+            m_values[m_tracked] = t;
+            return t + m_offset;
+         }
+
+         ++m_stats.triggered_scans;
+      }
+
+      return scan();
+   }
+
+   const std::vector<double>& values() const
+   {
+      return m_values;
+   }
+
+   const stats& get_stats() const
+   {
+      return m_stats;
    }
 
 private:
-   device m_dev;
-   std::vector<temp> m_temp;
+   double scan()
+   {
+      double max = -300.0;
+      size_t hottest = 0;
+
+      for (size_t i = 0; i < m_values.size(); ++i)
+      {
+         m_values[i] = (m_coretemp.begin() + i)->input();
+
+         if (m_values[i] > max)
+         {
+            max = m_values[i];
+            hottest = i;
+         }
+      }
+
+      if (m_stats.scans > 0)
+      {
+         // what we would have reported without this scan
+         double error = std::abs(max - (m_values[m_tracked] + m_offset));
+         m_stats.error_sum += error;
+         m_stats.error_max = std::max(m_stats.error_max, error);
+      }
+
+      m_tracked = m_package >= 0 ? m_package : hottest;
+      m_last_scan = m_values[m_tracked];
+      m_offset = max - m_last_scan;
+      m_since_scan = 0;
+      m_stats.reads += m_values.size();
+      ++m_stats.scans;
+
+      return max;
+   }
+
+   const coretemp& m_coretemp;
+   const unsigned m_scan_interval;
+   const double m_rescan_delta;
+   int m_package;
+   size_t m_tracked;
+   double m_offset;
+   double m_last_scan;
+   unsigned m_since_scan;
+   std::vector<double> m_values;
+   stats m_stats;
 };
 
 class fan
 {
 public:
-   static void get_object_range(const boost::filesystem::path& path, size_t& beg, size_t& end)
+   static void get_object_range(const boost::shared_ptr<sysfs::directory>& dir, size_t& beg, size_t& end)
    {
       beg = end = 1;
 
-      while (object(path / ("fan" + boost::lexical_cast<std::string>(end) + "_label")).exists())
+      while (object(dir, attribute_name("fan", end, "label")).exists())
       {
          ++end;
       }
    }
 
-   fan(const boost::filesystem::path& path, size_t index)
-      : m_input(path / ("fan" + boost::lexical_cast<std::string>(index) + "_input"))
-      , m_label(path / ("fan" + boost::lexical_cast<std::string>(index) + "_label"))
-      , m_manual(path / ("fan" + boost::lexical_cast<std::string>(index) + "_manual"))
-      , m_max(path / ("fan" + boost::lexical_cast<std::string>(index) + "_max"))
-      , m_min(path / ("fan" + boost::lexical_cast<std::string>(index) + "_min"))
-      , m_output(path / ("fan" + boost::lexical_cast<std::string>(index) + "_output"))
+   fan(const boost::shared_ptr<sysfs::directory>& dir, size_t index)
+      : m_input(dir, attribute_name("fan", index, "input"))
+      , m_label(dir, attribute_name("fan", index, "label"))
+      , m_manual(dir, attribute_name("fan", index, "manual"))
+      , m_max(dir, attribute_name("fan", index, "max"))
+      , m_min(dir, attribute_name("fan", index, "min"))
+      , m_output(dir, attribute_name("fan", index, "output"))
    {
    }
 
    double input() const
    {
-      return m_input.get<double>();
+      return m_input.get<unsigned>();
    }
 
    std::string label() const
@@ -298,57 +569,65 @@ public:
 
    bool manual() const
    {
-      return m_manual.get<bool>();
+      return m_manual.current();
    }
 
    double max() const
    {
-      return m_max.get<double>();
+      return m_max.get<unsigned>();
    }
 
    double min() const
    {
-      return m_min.get<double>();
+      return m_min.get<unsigned>();
    }
 
    double output() const
    {
-      return m_output.get<double>();
+      return m_output.current();
    }
 
-   void set_manual(bool value) const
+   void set_manual(bool value)
    {
       m_manual.set(value);
    }
 
-   void set_output(unsigned value) const
+   void set_output(unsigned value)
    {
       m_output.set(value);
    }
 
+   size_t commit(bool verify)
+   {
+      return m_manual.commit(verify) + m_output.commit(verify);
+   }
+
+   void add_samples(sysfs::sampler& s, unsigned group) const
+   {
+      s.add(m_input.attribute(), group);
+   }
+
 private:
    object m_input;
    object m_label;
-   object m_manual;
+   actuator<bool> m_manual;
    object m_max;
    object m_min;
-   object m_output;
+   actuator<unsigned> m_output;
 };
 
 class light
 {
 public:
-   light(const boost::filesystem::path& path)
-      : m_obj(path / "light")
+   light(const boost::shared_ptr<sysfs::directory>& dir)
+      : m_obj(dir, "light")
    {
    }
 
    unsigned value() const
    {
-      std::string val = m_obj.get<std::string>();
-      unsigned left, right;
-      ::sscanf(val.c_str(), "(%u,%u)", &left, &right);
-      return left + right;
+      std::pair<unsigned, unsigned> val = m_obj.get< std::pair<unsigned, unsigned> >();
+      return val.first + val.second;
    }
 
 private:
@@ -359,16 +638,17 @@ class cpu
 {
 public:
    cpu(const boost::filesystem::path& path)
-      : m_bios_limit(path / "cpufreq" / "bios_limit")
-      , m_cpuinfo_cur_freq(path / "cpufreq" / "cpuinfo_cur_freq")
-      , m_cpuinfo_max_freq(path / "cpufreq" / "cpuinfo_max_freq")
-      , m_cpuinfo_min_freq(path / "cpufreq" / "cpuinfo_min_freq")
-      , m_scaling_available_frequencies(path / "cpufreq" / "scaling_available_frequencies")
-      , m_scaling_cur_freq(path / "cpufreq" / "scaling_cur_freq")
-      , m_scaling_max_freq(path / "cpufreq" / "scaling_max_freq")
-      , m_scaling_min_freq(path / "cpufreq" / "scaling_min_freq")
-      , m_scaling_governor(path / "cpufreq" / "scaling_governor")
-      , m_core_id(path / "topology" / "core_id")
+      : m_dir(sysfs::directory::get(path))
+      , m_bios_limit(m_dir, "cpufreq/bios_limit")
+      , m_cpuinfo_cur_freq(m_dir, "cpufreq/cpuinfo_cur_freq")
+      , m_cpuinfo_max_freq(m_dir, "cpufreq/cpuinfo_max_freq")
+      , m_cpuinfo_min_freq(m_dir, "cpufreq/cpuinfo_min_freq")
+      , m_scaling_available_frequencies(m_dir, "cpufreq/scaling_available_frequencies")
+      , m_scaling_cur_freq(m_dir, "cpufreq/scaling_cur_freq")
+      , m_scaling_max_freq(m_dir, "cpufreq/scaling_max_freq")
+      , m_scaling_min_freq(m_dir, "cpufreq/scaling_min_freq")
+      , m_scaling_governor(m_dir, "cpufreq/scaling_governor")
+      , m_core_id(m_dir, "topology/core_id")
    {
    }
 
@@ -409,7 +689,7 @@ public:
 
    unsigned scaling_max_freq() const
    {
-      return m_scaling_max_freq.get<unsigned>();
+      return m_scaling_max_freq.current();
    }
 
    std::string scaling_governor() const
@@ -420,10 +700,7 @@ public:
    template <typename OutputIterator>
    void scaling_available_frequencies(OutputIterator out) const
    {
-      std::string freq = m_scaling_available_frequencies.get<std::string>();
-      std::istringstream iss(freq);
-      std::istream_iterator<unsigned> in(iss);
-      std::copy(in, std::istream_iterator<unsigned>(), out);
+      m_scaling_available_frequencies.get_list<unsigned>(out);
    }
 
    unsigned core_id() const
@@ -431,19 +708,25 @@ public:
       return m_core_id.get<unsigned>();
    }
 
-   void set_scaling_max_freq(unsigned value) const
+   void set_scaling_max_freq(unsigned value)
    {
       m_scaling_max_freq.set(value);
    }
 
+   size_t commit(bool verify)
+   {
+      return m_scaling_max_freq.commit(verify);
+   }
+
 private:
+   boost::shared_ptr<sysfs::directory> m_dir;
    object m_bios_limit;
    object m_cpuinfo_cur_freq;
    object m_cpuinfo_max_freq;
    object m_cpuinfo_min_freq;
    object m_scaling_available_frequencies;
    object m_scaling_cur_freq;
-   object m_scaling_max_freq;
+   actuator<unsigned> m_scaling_max_freq;
    object m_scaling_min_freq;
    object m_scaling_governor;
    object m_core_id;
@@ -501,33 +784,24 @@ public:
       return oss.str();
    }
 
-   void dump(std::ostream& os) const
+   void set_scaling_max_freq(unsigned value)
    {
-      for (const_iterator it = begin(); it != end(); ++it)
+      for (std::vector<cpu>::iterator it = m_cpu.begin(); it != m_cpu.end(); ++it)
       {
-         os << "Core " << it->core_id() << ": " << freq2str(it->scaling_cur_freq()) << " (" << it->scaling_governor()
-            << ", max: " << freq2str(it->scaling_max_freq()) << ")\n";
+         it->set_scaling_max_freq(value);
       }
    }
 
-   unsigned scaling_max_freq() const
+   size_t commit(bool verify)
    {
-      unsigned freq = 0;
+      size_t writes = 0;
 
-      for (const_iterator it = begin(); it != end(); ++it)
+      for (std::vector<cpu>::iterator it = m_cpu.begin(); it != m_cpu.end(); ++it)
       {
-         freq = std::max(freq, it->scaling_max_freq());
+         writes += it->commit(verify);
       }
 
-      return freq;
-   }
-
-   void set_scaling_max_freq(unsigned value) const
-   {
-      for (const_iterator it = begin(); it != end(); ++it)
-      {
-         it->set_scaling_max_freq(value);
-      }
+      return writes;
    }
 
    template <typename OutputIterator>
@@ -540,19 +814,27 @@ private:
    std::vector<cpu> m_cpu;
 };
 
+/*
+ * Energies are returned in Wh. Drivers report either energy_* (uWh) or
+ * charge_* (uAh) attributes; charges are converted using the design
+ * voltage, so the current and full energy stay in proportion.
+ */
 class power
 {
 public:
    power(const boost::filesystem::path& path)
-      : m_online(path / "online")
-      , m_present(path / "present")
-      , m_type(path / "type")
-      , m_energy_full(path / "charge_full")
-      , m_energy_full_design(path / "charge_full_design")
-      , m_energy_now(path / "charge_now")
-      , m_voltage_min_design(path / "voltage_min_design")
-      , m_voltage_now(path / "voltage_now")
-      , m_power_now(path / "power_now")
+      : m_dir(sysfs::directory::get(path))
+      , m_online(m_dir, "online")
+      , m_present(m_dir, "present")
+      , m_type(m_dir, "type")
+      , m_has_energy(object(m_dir, "energy_now").exists())
+      , m_energy_full(m_dir, m_has_energy ? "energy_full" : "charge_full")
+      , m_energy_full_design(m_dir, m_has_energy ? "energy_full_design" : "charge_full_design")
+      , m_energy_now(m_dir, m_has_energy ? "energy_now" : "charge_now")
+      , m_voltage_min_design(m_dir, "voltage_min_design")
+      , m_voltage_now(m_dir, "voltage_now")
+      , m_power_now(m_dir, "power_now")
+      , m_voltage(0.0)
    {
    }
 
@@ -573,53 +855,87 @@ public:
 
    double energy_full() const
    {
-      return 1e-6*m_energy_full.get<double>();
+      return to_energy(1e-6*m_energy_full.get<long>());
    }
 
    double energy_full_design() const
    {
-      return 1e-6*m_energy_full_design.get<double>();
+      return to_energy(1e-6*m_energy_full_design.get<long>());
    }
 
    double energy_now() const
    {
-      return 1e-6*m_energy_now.get<double>();
+      return to_energy(1e-6*m_energy_now.get<long>());
    }
 
    double voltage_min_design() const
    {
-      return 1e-6*m_voltage_min_design.get<double>();
+      return 1e-6*m_voltage_min_design.get<long>();
    }
 
    double voltage_now() const
    {
-      return 1e-6*m_voltage_now.get<double>();
+      return 1e-6*m_voltage_now.get<long>();
    }
 
    double power_now() const
    {
-      return 1e-6*m_power_now.get<double>();
+      return 1e-6*m_power_now.get<long>();
+   }
+
+   void add_online_sample(sysfs::sampler& s, unsigned group) const
+   {
+      s.add(m_online.attribute(), group);
+   }
+
+   void add_energy_sample(sysfs::sampler& s, unsigned group) const
+   {
+      s.add(m_energy_now.attribute(), group);
    }
 
 private:
+   double to_energy(double value) const
+   {
+      if (m_has_energy)
+      {
+         return value;
+      }
+
+      if (m_voltage <= 0.0)
+      {
+         m_voltage = voltage_min_design();
+
+         if (m_voltage <= 0.0)
+         {
+            return value*voltage_now();
+         }
+      }
+
+      return value*m_voltage;
+   }
+
+   boost::shared_ptr<sysfs::directory> m_dir;
    object m_online;
    object m_present;
    object m_type;
+   const bool m_has_energy;
    object m_energy_full;
    object m_energy_full_design;
    object m_energy_now;
    object m_voltage_min_design;
    object m_voltage_now;
    object m_power_now;
+   mutable double m_voltage;
 };
 
 class led
 {
 public:
    led(const boost::filesystem::path& path)
-      : m_actual_brightness(path / "actual_brightness")
-      , m_brightness(path / "brightness")
-      , m_max_brightness(path / "max_brightness")
+      : m_dir(sysfs::directory::get(path))
+      , m_actual_brightness(m_dir, "actual_brightness")
+      , m_brightness(m_dir, "brightness")
+      , m_max_brightness(m_dir, "max_brightness")
    {
    }
 
@@ -644,6 +960,7 @@ public:
    }
 
 private:
+   boost::shared_ptr<sysfs::directory> m_dir;
    object m_actual_brightness;
    object m_brightness;
    object m_max_brightness;
@@ -655,55 +972,56 @@ public:
    typedef std::vector<fan>::const_iterator const_fan_iterator;
    typedef std::vector<temp>::const_iterator const_temp_iterator;
 
-   applesmc(const std::string& basepath)
-      : m_dev(basepath, "applesmc")
-      , m_light(m_dev.path())
+   applesmc(const device_finder& finder)
+      : m_dev(finder, "applesmc")
+      , m_light(m_dev.dir())
       , m_kbd_backlight(m_dev.path() / "leds" / "smc::kbd_backlight")
    {
       size_t beg, end;
 
-      fan::get_object_range(m_dev.path(), beg, end);
+      fan::get_object_range(m_dev.dir(), beg, end);
 
       while (beg != end)
       {
-         m_fan.push_back(fan(m_dev.path(), beg++));
+         m_fan.push_back(fan(m_dev.dir(), beg++));
       }
 
-      temp::get_object_range(m_dev.path(), beg, end);
+      temp::get_object_range(m_dev.dir(), beg, end);
 
       while (beg != end)
       {
-         temp t(m_dev.path(), beg++);
+         temp t(m_dev.dir(), beg++);
          m_tmap[t.label()] = m_temp.size();
          m_temp.push_back(t);
       }
    }
 
-   void dump(std::ostream& os) const
+   void set_fan_speed(unsigned value)
    {
-      for (const_fan_iterator it = fan_begin(); it != fan_end(); ++it)
+      for (std::vector<fan>::iterator it = m_fan.begin(); it != m_fan.end(); ++it)
+      {
+         it->set_manual(true);
+         it->set_output(value);
+      }
+   }
+
+   size_t commit(bool verify)
+   {
+      size_t writes = 0;
+
+      for (std::vector<fan>::iterator it = m_fan.begin(); it != m_fan.end(); ++it)
       {
-         os << it->label() << ": " << it->input() << " rpm (" << it->output() << " rpm) [" << (it->manual() ? "MANUAL" : "AUTO") << "]\n";
+         writes += it->commit(verify);
       }
 
-      os << "Palm Rest: " << get_temp("Ts0P").input() << "°C\n";
-      os << "Ambient Light: " << m_light.value() << "\n";
-      os << "Keyboard Backlight: " << m_kbd_backlight.brightness() << "/" << m_kbd_backlight.max_brightness() << "\n";
+      return writes;
    }
 
-   void set_fan_speed(unsigned value) const
+   void add_samples(sysfs::sampler& s, unsigned group) const
    {
       for (const_fan_iterator it = fan_begin(); it != fan_end(); ++it)
       {
-         if (!it->manual())
-         {
-            it->set_manual(true);
-         }
-
-         if (it->output() != value)
-         {
-            it->set_output(value);
-         }
+         it->add_samples(s, group);
       }
    }
 
@@ -727,6 +1045,11 @@ public:
       return m_temp.end();
    }
 
+   bool has_temp(const std::string& name) const
+   {
+      return m_tmap.find(name) != m_tmap.end();
+   }
+
    const temp& get_temp(const std::string& name) const
    {
       std::map<std::string, size_t>::const_iterator it = m_tmap.find(name);
@@ -744,6 +1067,11 @@ public:
       return m_kbd_backlight;
    }
 
+   const light& ambient_light() const
+   {
+      return m_light;
+   }
+
    const boost::filesystem::path& path() const
    {
       return m_dev.path();
@@ -758,93 +1086,767 @@ private:
    led m_kbd_backlight;
 };
 
-}
+// Sensor properties that do not change while the daemon is running
+struct sensor_info
+{
+   struct temp_sensor
+   {
+      std::string label;
+      double max;
+      double crit;
+   };
+
+   std::vector<temp_sensor> coretemp;
+   std::vector<std::string> fan;
+   std::vector<unsigned> core_id;
+   std::vector<unsigned> available_frequencies;  // sorted
+   bool cpu_configurable;
+   bool has_palm_rest;
+   unsigned display_backlight_max;
+   unsigned keyboard_backlight_max;
+};
 
-class monitor_impl : public boost::enable_shared_from_this<monitor_impl>
-                   , public event_handler
-                   , public status_provider
+/*
+ * Sampling periods of the sensor groups. Each group has its own period;
+ * a wakeup is scheduled for the earliest deadline and serves all groups
+ * that are due by then, including those that would become due within a
+ * quarter of their period, so groups with similar periods share wakeups.
+ * Deadlines advance by whole periods, which keeps groups with periods
+ * that are multiples of each other aligned.
+ */
+class sensor_schedule
 {
 public:
-   monitor_impl(boost::asio::io_service& ios, root_logger& root, const monitor::settings& set);
-   void start();
-   void stop();
-   void ensure_safe_defaults();
+   enum group
+   {
+      CPU_TEMP,
+      FAN,
+      BATTERY,
+      AC,
+      LIGHT,
+      CPUFREQ,
+      GROUPS
+   };
 
-   virtual void handle_event(event_code::type code);
-   virtual void status(std::ostream& os) const;
+   typedef std::chrono::steady_clock clock;
 
-private:
-   void on_periodic_check(const boost::system::error_code& e);
-   void on_idle(const boost::system::error_code& e);
+   static uint32_t mask(group g)
+   {
+      return uint32_t(1) << g;
+   }
 
-   void restart_periodic_check();
-   void restart_idle();
+   sensor_schedule()
+   {
+      for (size_t i = 0; i < GROUPS; ++i)
+      {
+         m_period[i] = clock::duration::zero();
+      }
+   }
 
-   void enter_idle(unsigned level);
-   void leave_idle();
+   void set_period(group g, clock::duration period)
+   {
+      m_period[g] = period;
+   }
 
-   const monitor::settings::power_mode& power_settings() const;
+   clock::duration period(group g) const
+   {
+      return m_period[g];
+   }
 
-   void update_stats();
-   void run_checks();
-   void check_fan();
-   void check_cpu();
+   // make all groups due at the given time
+   void reset(clock::time_point now)
+   {
+      for (size_t i = 0; i < GROUPS; ++i)
+      {
+         m_deadline[i] = now;
+      }
+   }
 
-   double current_power() const;
-   unsigned cpu_max_speed() const;
+   // return the groups due at the given time and advance their deadlines
+   uint32_t due(clock::time_point now)
+   {
+      uint32_t groups = 0;
 
-   int calc_brightness(const monitor::settings::brightness& set, int cur, int max, bool up, bool slow) const;
-   void set_display_brightness(bool up, bool slow);
-   void set_keyboard_brightness(bool up, bool slow);
+      for (size_t i = 0; i < GROUPS; ++i)
+      {
+         if (m_deadline[i] <= now + m_period[i]/4)
+         {
+            groups |= uint32_t(1) << i;
+            m_deadline[i] += m_period[i];
 
-   static const size_t HISTORY_LENGTH = 300;  // 5 minutes
+            // don't try to catch up after a long delay
+            if (m_deadline[i] <= now)
+            {
+               m_deadline[i] = now + m_period[i];
+            }
+         }
+      }
 
-   boost::asio::io_service& m_ios;
-   boost::asio::deadline_timer m_timer;
-   boost::asio::deadline_timer m_idle_timer;
-   coretemp m_coretemp;
-   applesmc m_applesmc;
-   cpuinfo m_cpuinfo;
-   led m_backlight;
-   power m_ac;
-   power m_battery;
-   unsigned m_original_display_backlight;
-   unsigned m_original_keyboard_backlight;
-   unsigned m_idle_level;
-   unsigned m_saved_display_backlight;
-   unsigned m_saved_keyboard_backlight;
-   bool m_on_ac;
-   std::vector<double> m_temp_history;
-   std::vector<double> m_energy_history;
-   size_t m_history_size;
-   size_t m_history_count;
-   double m_fan_temp;
-   double m_fan_hot;
-   double m_fan_cold;
-   double m_cpu_temp;
-   double m_cpu_hot;
+      return groups;
+   }
+
+   clock::time_point deadline(group g) const
+   {
+      return m_deadline[g];
+   }
+
+   void set_deadline(group g, clock::time_point when)
+   {
+      m_deadline[g] = when;
+   }
+
+   clock::time_point next() const
+   {
+      return *std::min_element(m_deadline, m_deadline + GROUPS);
+   }
+
+private:
+   clock::duration m_period[GROUPS];
+   clock::time_point m_deadline[GROUPS];
+};
+
+/*
+ * Adapts the period of the thermal control loop. While temperature and
+ * load are flat, or the lid is closed, the period grows by half each
+ * tick up to a maximum; any temperature jump, a steep slope or load
+ * above the threshold snaps it back to the base period, as does an input
+ * event through wake(). The slope is fitted over the last few maximum
+ * periods, so a single sensor flicker doesn't count as a trend.
+ */
+class tick_controller
+{
+public:
+   typedef monitor::settings::duration duration;
+
+   static const size_t SLOPE_PERIODS = 4;
+
+   tick_controller(duration base, duration max, double quiet_slope, double quiet_load, double jump)
+      : m_base(base)
+      , m_max(std::max(base, max))
+      , m_quiet_slope(quiet_slope)
+      , m_quiet_load(quiet_load)
+      , m_jump(jump)
+      , m_interval(base)
+      , m_last_temp(-300.0)
+      , m_time(0.0)
+   {
+   }
+
+   // elapsed is the time since the last call
+   duration update(double temp, double load, bool lid_closed, duration elapsed)
+   {
+      double delta = m_last_temp > -280.0 ? std::abs(temp - m_last_temp) : 0.0;
+      double window = SLOPE_PERIODS*std::chrono::duration<double>(m_max).count();
+
+      m_last_temp = temp;
+      m_time += std::max(std::chrono::duration<double>(elapsed).count(), 0.0);
+
+      m_samples.push_back(std::make_pair(m_time, temp));
+      m_fit.add(m_time, temp);
+
+      while (m_samples.back().first - m_samples.front().first > window)
+      {
+         m_fit.remove(m_samples.front().first, m_samples.front().second);
+         m_samples.pop_front();
+      }
+
+      bool flat = m_samples.size() >= 3 && m_samples.back().first > m_samples.front().first &&
+                  std::abs(m_fit.slope()) <= m_quiet_slope;
+      bool quiet = flat && load <= m_quiet_load;
+
+      if (delta > m_jump)
+      {
+         m_interval = m_base;
+      }
+      else if (quiet || lid_closed)
+      {
+         m_interval = std::min(m_max, m_interval + std::max(m_interval/2, duration(1)));
+      }
+      else
+      {
+         m_interval = m_base;
+      }
+
+      return m_interval;
+   }
+
+   // returns true if the period was shortened
+   bool wake()
+   {
+      bool changed = m_interval != m_base;
+      m_interval = m_base;
+      return changed;
+   }
+
+   duration interval() const
+   {
+      return m_interval;
+   }
+
+private:
+   const duration m_base;
+   const duration m_max;
+   const double m_quiet_slope;
+   const double m_quiet_load;
+   const double m_jump;
+   duration m_interval;
+   double m_last_temp;
+   double m_time;
+   std::deque<std::pair<double, double> > m_samples;
+   linear_regression m_fit;
+};
+
+/*
+ * Estimates battery power as the slope of a least-squares line through
+ * the energy readings of the last window. Unlike a difference of two
+ * points, every reading in the window contributes, so single quantized
+ * or noisy readings hardly move the result.
+ */
+class power_estimator
+{
+public:
+   typedef time_series<double>::clock clock;
+
+   power_estimator(monitor::settings::duration window, size_t min_samples)
+      : m_window(window)
+      , m_min_samples(std::max<size_t>(min_samples, 3))
+   {
+   }
+
+   void reset()
+   {
+      m_samples.clear();
+      m_fit.clear();
+   }
+
+   // energy in Wh
+   void add(clock::time_point t, double energy)
+   {
+      m_samples.push_back(std::make_pair(seconds(t), energy));
+      m_fit.add(m_samples.back().first, energy);
+
+      while (m_samples.back().first - m_samples.front().first > seconds(m_window))
+      {
+         m_fit.remove(m_samples.front().first, m_samples.front().second);
+         m_samples.pop_front();
+      }
+   }
+
+   // needs enough samples spread over at least half the window
+   bool valid() const
+   {
+      return m_samples.size() >= m_min_samples &&
+             m_samples.back().first - m_samples.front().first >= seconds(m_window)/2;
+   }
+
+   // power drawn from the battery in W
+   double power() const
+   {
+      return -3600.0*m_fit.slope();
+   }
+
+   // standard error of power()
+   double error() const
+   {
+      return 3600.0*m_fit.slope_error();
+   }
+
+   double r2() const
+   {
+      return m_fit.r2();
+   }
+
+private:
+   template <typename T>
+   static double seconds(T t)
+   {
+      return std::chrono::duration<double>(t).count();
+   }
+
+   static double seconds(clock::time_point t)
+   {
+      return seconds(t.time_since_epoch());
+   }
+
+   const monitor::settings::duration m_window;
+   const size_t m_min_samples;
+   std::deque<std::pair<double, double> > m_samples;
+   linear_regression m_fit;
+};
+
+/*
+ * PID controller for the fan speed, driven by temperature. The
+ * derivative acts on the measurement rather than the error, so setpoint
+ * changes don't kick the output. The output may change by at most slew
+ * units per second, and integration stops while the applied output,
+ * after clamping and slewing, lags behind in the direction of the error
+ * (anti-windup).
+ */
+class pid_controller
+{
+public:
+   pid_controller()
+      : m_integral(0.0)
+      , m_output(0.0)
+      , m_last(0.0)
+      , m_init(false)
+   {
+   }
+
+   bool running() const
+   {
+      return m_init;
+   }
+
+   // continue smoothly from the given output
+   void reset(double output)
+   {
+      m_output = output;
+      m_init = false;
+   }
+
+   double update(const monitor::settings::power_mode& p, double measurement, double dt)
+   {
+      double error = measurement - p.fan_pid_setpoint;
+      double lo = p.fan_speed_min, hi = p.fan_speed_max;
+
+      if (!m_init)
+      {
+         // choose the integral such that the output doesn't jump
+         m_integral = std::min(std::max(m_output, lo), hi) - p.fan_pid_kp*error;
+         m_last = measurement;
+         m_init = true;
+      }
+
+      if (dt <= 0.0)
+      {
+         return m_output;
+      }
+
+      double derivative = (measurement - m_last)/dt;
+      double integral = m_integral + p.fan_pid_ki*error*dt;
+      double u = p.fan_pid_kp*error + integral + p.fan_pid_kd*derivative;
+      double applied = std::min(std::max(u, lo), hi);
+
+      m_last = measurement;
+
+      if (p.fan_pid_slew > 0.0)
+      {
+         double step = p.fan_pid_slew*dt;
+         applied = std::min(std::max(applied, m_output - step), m_output + step);
+      }
+
+      // don't integrate while the applied output is held back in the direction of the error
+      if (!((applied < u && error > 0.0) || (applied > u && error < 0.0)))
+      {
+         m_integral = integral;
+      }
+
+      m_output = applied;
+
+      return m_output;
+   }
+
+private:
+   double m_integral;
+   double m_output;
+   double m_last;
+   bool m_init;
+};
+
+/*
+ * Learns the typical power draw of each usage profile (AC or battery,
+ * idle level, throttled or not) and predicts the power of the current
+ * profile by blending the learned value with the live estimate, trusting
+ * the estimate more the better its fit. This keeps predictions sensible
+ * right after a profile change, when the estimate still covers the old
+ * profile or is not yet available.
+ */
+class battery_predictor
+{
+public:
+   static const size_t PROFILES = 2*3*2;
+
+   battery_predictor()
+      : m_learned(PROFILES, std::make_pair(0.0, false))
+   {
+   }
+
+   static size_t profile(bool on_ac, unsigned idle_level, bool throttled)
+   {
+      return (3*on_ac + std::min(idle_level, 2u))*2 + throttled;
+   }
+
+   void learn(size_t profile, double power)
+   {
+      std::pair<double, bool>& l = m_learned[profile];
+      l.first = l.second ? l.first + LEARN_RATE*(power - l.first) : power;
+      l.second = true;
+   }
+
+   // power in W, negative while charging; returns false if unknown
+   // settled means the estimate only covers the current profile
+   bool predict(size_t profile, const power_estimator& est, bool settled, double& power) const
+   {
+      const std::pair<double, bool>& l = m_learned[profile];
+
+      if (est.valid() && (settled || !l.second))
+      {
+         double w = l.second ? est.r2() : 1.0;
+         power = w*est.power() + (1.0 - w)*l.first;
+         return true;
+      }
+
+      power = l.first;
+      return l.second;
+   }
+
+private:
+   static const double LEARN_RATE;
+
+   std::vector<std::pair<double, bool> > m_learned;
+};
+
+const double battery_predictor::LEARN_RATE = 0.02;
+
+// first field of /proc/loadavg
+class loadavg
+{
+public:
+   loadavg()
+      : m_attr("/proc/loadavg")
+   {
+   }
+
+   double value() const
+   {
+      char buf[128];
+      size_t len = m_attr.read(buf, sizeof(buf));
+      const char *end = static_cast<const char *>(::memchr(buf, ' ', len));
+      return sysfs::value_traits<double>::parse(buf, end ? end : buf + len);
+   }
+
+private:
+   sysfs::attribute m_attr;
+};
+
+/*
+ * All sensor readings of a single tick. A snapshot is never modified
+ * after it has been taken, so it can be handed out to both the control
+ * loop and the status server.
+ */
+struct sensor_snapshot
+{
+   struct fan_state
+   {
+      double input;
+      double output;
+      bool manual;
+   };
+
+   struct cpu_state
+   {
+      unsigned scaling_cur_freq;
+      unsigned scaling_max_freq;
+      std::string scaling_governor;
+   };
+
+   void dump(std::ostream& os) const
+   {
+      for (size_t i = 0; i < coretemp.size(); ++i)
+      {
+         const sensor_info::temp_sensor& t = info->coretemp[i];
+         os << t.label << ": " << coretemp[i] << "°C (max: " << t.max << "°C, crit: " << t.crit << "°C)\n";
+      }
+
+      for (size_t i = 0; i < fan.size(); ++i)
+      {
+         os << info->fan[i] << ": " << fan[i].input << " rpm (" << fan[i].output << " rpm) [" << (fan[i].manual ? "MANUAL" : "AUTO") << "]\n";
+      }
+
+      if (info->has_palm_rest)
+      {
+         os << "Palm Rest: " << palm_rest_temp << "°C\n";
+      }
+
+      os << "Ambient Light: " << ambient_light << "\n";
+      os << "Keyboard Backlight: " << keyboard_backlight << "/" << info->keyboard_backlight_max << "\n";
+
+      for (size_t i = 0; i < cpu.size(); ++i)
+      {
+         os << "Core " << info->core_id[i] << ": " << cpuinfo::freq2str(cpu[i].scaling_cur_freq) << " (" << cpu[i].scaling_governor
+            << ", max: " << cpuinfo::freq2str(cpu[i].scaling_max_freq) << ")\n";
+      }
+
+      os << "Display Backlight: " << display_backlight << "/" << info->display_backlight_max << "\n";
+      coretemp_stats.dump(os);
+   }
+
+   boost::shared_ptr<const sensor_info> info;
+   std::vector<double> coretemp;
+   double max_temp;
+   double load;
+   coretemp_sampler::stats coretemp_stats;
+   std::vector<fan_state> fan;
+   double palm_rest_temp;
+   unsigned ambient_light;
+   unsigned keyboard_backlight;
+   std::vector<cpu_state> cpu;
+   unsigned scaling_max_freq;
+   unsigned display_backlight;
+   bool on_ac;
+   double energy_now;
+   double energy_full;
+   double power_now;
+};
+
+}
+
+class monitor_impl : public boost::enable_shared_from_this<monitor_impl>
+                   , public event_handler
+                   , public status_provider
+{
+public:
+   monitor_impl(boost::asio::io_service& ios, root_logger& root, const monitor::settings& set);
+   void start();
+   void stop();
+   void ensure_safe_defaults();
+
+   virtual void handle_event(event_code::type code);
+   virtual void status(std::ostream& os) const;
+   virtual void query(const std::string& request, std::ostream& os) const;
+   void latency_report(std::ostream& os) const;
+
+private:
+   void on_periodic_check(const boost::system::error_code& e);
+   void on_power_supply_event(const power_supply_event& ev);
+   void on_ac_resync(std::exception_ptr error, bool online);
+   void on_idle(const boost::system::error_code& e);
+
+   void restart_periodic_check();
+   void wake_periodic_check();
+   void restart_idle();
+
+   void enter_idle(unsigned level);
+   void leave_idle();
+
+   const monitor::settings::power_mode& power_settings() const;
+   void set_power_mode(bool on_ac);
+
+   void init_sensor_info();
+   boost::shared_ptr<sensor_snapshot> take_snapshot(bool on_ac, uint32_t groups, boost::shared_ptr<const sensor_snapshot> prev);
+   void on_snapshot(std::exception_ptr error, boost::shared_ptr<sensor_snapshot> snap, uint32_t groups);
+   void publish_snapshot(boost::shared_ptr<sensor_snapshot> snap);
+   void on_backlight_changed(const char *buf, size_t len);
+   size_t commit_changes(bool verify);
+   void on_commit(std::exception_ptr error, size_t writes);
+
+   void update_stats(size_t slots);
+   size_t reset_windows();
+   std::vector<std::string> history_channels() const;
+   void run_checks();
+   void check_fan();
+   void check_cpu();
+
+   double current_power() const;
+   size_t current_profile() const;
+   void update_prediction();
+   void filter_snapshot(sensor_snapshot& snap, uint32_t groups);
+   unsigned cpu_max_speed() const;
+
+   void set_display_backlight(unsigned brightness);
+   int calc_brightness(const monitor::settings::brightness& set, int cur, int max, bool up, bool slow) const;
+   void set_display_brightness(bool up, bool slow);
+   void set_keyboard_brightness(bool up, bool slow);
+
+   boost::asio::io_service& m_ios;
+   io_pool m_io;
+   boost::asio::steady_timer m_timer;
+   boost::asio::steady_timer m_idle_timer;
+   device_finder m_devices;
+   coretemp m_coretemp;
+   coretemp_sampler m_coretemp_sampler;
+   applesmc m_applesmc;
+   cpuinfo m_cpuinfo;
+   loadavg m_loadavg;
+   led m_backlight;
+   led m_sampled_backlight;
+   led m_sampled_keyboard_backlight;
+   power m_ac;
+   power m_battery;
+   std::string m_ac_name;
+   boost::shared_ptr<power_supply_watcher> m_power_watcher;
+   boost::shared_ptr<sysfs::attribute_watch> m_backlight_watch;
+   unsigned m_display_backlight;
+   unsigned m_display_backlight_set;
+   sysfs::sampler m_sampler;
+   sensor_schedule m_schedule;
+   tick_controller m_ticks;
+   power_estimator m_power;
+   pid_controller m_fan_pid;
+   battery_predictor m_predictor;
+   size_t m_profile;
+   time_series<double>::clock::time_point m_profile_since;
+   double m_time_to_empty;
+   double m_time_to_full;
+   bool m_low_battery;
+   std::deque<sensor_schedule::clock::time_point> m_wakeups;
+   sensor_schedule::clock::time_point m_tick_start;
+   sensor_schedule::clock::time_point m_tick_deadline;
+   sensor_schedule::clock::time_point m_last_control;
+   sensor_schedule::clock::time_point m_next_verify;
+   monitor::settings::duration m_tick;
+   bool m_tick_pending;
+   boost::shared_ptr<const sensor_info> m_info;
+   boost::shared_ptr<const sensor_snapshot> m_snapshot;
+   unsigned m_original_display_backlight;
+   unsigned m_original_keyboard_backlight;
+   unsigned m_idle_level;
+   unsigned m_saved_display_backlight;
+   unsigned m_saved_keyboard_backlight;
+   bool m_on_ac;
+   time_series<double> m_history;
+   boost::shared_ptr<history_file> m_history_file;
+   boost::shared_ptr<rollup> m_rollup;
+   dynamic_filter<double> m_max_temp_filter;
+   std::vector<dynamic_filter<double> > m_core_filters;
+   std::vector<dynamic_filter<double> > m_fan_filters;
+   std::vector<double> m_history_values;
+   size_t m_core_channel;
+   size_t m_fan_channel;
+   size_t m_cpu_channel;
+   sliding_min<double> m_fan_hot_window;
+   sliding_max<double> m_fan_cold_window;
+   sliding_min<double> m_cpu_hot_window;
+   sliding_max<double> m_cpu_cold_window;
+   size_t m_history_size;
+   size_t m_history_count;
+   double m_fan_temp;
+   double m_fan_hot;
+   double m_fan_cold;
+   double m_cpu_temp;
+   double m_cpu_hot;
    double m_cpu_cold;
-   size_t m_cpu_throttle_time;
-   size_t m_cpu_unthrottle_time;
+   monitor::settings::duration m_cpu_throttle_time;
+   monitor::settings::duration m_cpu_unthrottle_time;
    const monitor::settings m_set;
    logger m_log;
    bool m_stopped;
 };
 
+namespace {
+
+void parse_duration(const std::string& str, monitor::settings::duration *target)
+{
+   const char *beg = str.c_str();
+   char *end;
+   double value = ::strtod(beg, &end);
+   std::string unit(end);
+
+   if (end == beg || value < 0.0 || !(unit.empty() || unit == "s" || unit == "ms"))
+   {
+      throw std::runtime_error("invalid duration: " + str);
+   }
+
+   *target = monitor::settings::duration(static_cast<long>(std::lround(unit == "ms" ? value : 1e3*value)));
+}
+
+boost::program_options::typed_value<std::string> *duration_value(monitor::settings::duration *target, const char *def)
+{
+   return boost::program_options::value<std::string>()->default_value(def)->notifier(boost::bind(&parse_duration, _1, target));
+}
+
+// for durations used as divisors
+void parse_positive_duration(const std::string& str, monitor::settings::duration *target)
+{
+   parse_duration(str, target);
+
+   if (*target <= monitor::settings::duration::zero())
+   {
+      throw std::runtime_error("duration must be at least 1ms: " + str);
+   }
+}
+
+boost::program_options::typed_value<std::string> *positive_duration_value(monitor::settings::duration *target, const char *def)
+{
+   return boost::program_options::value<std::string>()->default_value(def)->notifier(boost::bind(&parse_positive_duration, _1, target));
+}
+
+void parse_fan_mode(const std::string& str, monitor::settings::fan_control *target)
+{
+   if (str == "stepped")
+   {
+      *target = monitor::settings::FAN_STEPPED;
+   }
+   else if (str == "curve")
+   {
+      *target = monitor::settings::FAN_CURVE;
+   }
+   else if (str == "pid")
+   {
+      *target = monitor::settings::FAN_PID;
+   }
+   else
+   {
+      throw std::runtime_error("invalid fan mode: " + str);
+   }
+}
+
+boost::program_options::typed_value<std::string> *fan_mode_value(monitor::settings::fan_control *target, const char *def)
+{
+   return boost::program_options::value<std::string>()->default_value(def)->notifier(boost::bind(&parse_fan_mode, _1, target));
+}
+
+std::string format_minutes(double seconds)
+{
+   long minutes = std::lround(seconds/60.0);
+   std::ostringstream os;
+   os << minutes/60 << "h" << std::setw(2) << std::setfill('0') << minutes%60 << "m";
+   return os.str();
+}
+
+}
+
 void monitor::settings::add_options(boost::program_options::options_description& od)
 {
    using namespace boost::program_options;
 
    od.add_options()
       ("monitor.hwmon_base_path", value<std::string>(&hwmon_base_path)->default_value("/sys/devices/platform"))
+      ("monitor.hwmon_class_path", value<std::string>(&hwmon_class_path)->default_value("/sys/class/hwmon"))
+      ("monitor.device_cache", value<std::string>(&device_cache)->default_value("/var/cache/aird/devices"))
+      ("monitor.history_file", value<std::string>(&history_file)->default_value("/run/aird/history"))
+      ("monitor.history_tiers", value<std::string>(&history_tiers)->default_value("1s:10m 10s:6h 5m:7d"))
+      ("monitor.temp_filter", value<std::string>(&temp_filter)->default_value(""))
+      ("monitor.fan_filter", value<std::string>(&fan_filter)->default_value(""))
       ("monitor.intel_backlight_path", value<std::string>(&intel_backlight_path)->default_value("/sys/class/backlight/intel_backlight"))
       ("monitor.battery_path", value<std::string>(&battery_path)->default_value("/sys/class/power_supply/BAT0"))
       ("monitor.ac_path", value<std::string>(&ac_path)->default_value("/sys/class/power_supply/ADP1"))
       ("monitor.cpu_base_path", value<std::string>(&cpu_base_path)->default_value("/sys/bus/cpu/devices"))
 
-      ("monitor.check_interval", value<unsigned>(&check_interval)->default_value(1))
-      ("monitor.power_interval", value<unsigned>(&power_interval)->default_value(30))
+      ("monitor.check_interval", positive_duration_value(&check_interval, "250ms"))
+      ("monitor.max_check_interval", positive_duration_value(&max_check_interval, "5"))
+      ("monitor.quiet_temp_slope", value<double>(&quiet_temp_slope)->default_value(0.1))
+      ("monitor.quiet_load", value<double>(&quiet_load)->default_value(0.5))
+      ("monitor.temp_jump", value<double>(&temp_jump)->default_value(2.0))
+      ("monitor.timer_slack", duration_value(&timer_slack, "0"))
+      ("monitor.align_wakeups", value<bool>(&align_wakeups)->default_value(false))
+      ("monitor.fan_interval", duration_value(&fan_interval, "5"))
+      ("monitor.battery_interval", duration_value(&battery_interval, "5"))
+      ("monitor.ac_interval", duration_value(&ac_interval, "10"))
+      ("monitor.light_interval", duration_value(&light_interval, "5"))
+      ("monitor.cpufreq_interval", duration_value(&cpufreq_interval, "5"))
+      ("monitor.power_interval", duration_value(&power_interval, "30"))
       ("monitor.power_measurements", value<unsigned>(&power_measurements)->default_value(3))
+      ("monitor.actuator_verify_interval", duration_value(&actuator_verify_interval, "60"))
+      ("monitor.io_threads", value<unsigned>(&io_threads)->default_value(1))
+      ("monitor.sampler", value<std::string>(&sampler)->default_value("pread"))
+      ("monitor.power_supply_events", value<bool>(&power_supply_events)->default_value(true))
+      ("monitor.watch_attributes", value<bool>(&watch_attributes)->default_value(true))
+      ("monitor.coretemp_scan_interval", value<unsigned>(&coretemp_scan_interval)->default_value(10))
+      ("monitor.coretemp_rescan_delta", value<double>(&coretemp_rescan_delta)->default_value(2.0))
+      ("monitor.latency_budget_ms", value<unsigned>(&latency_budget_ms)->default_value(20))
+      ("monitor.latency_report_size", value<unsigned>(&latency_report_size)->default_value(10))
       ("monitor.idle_timeout:ac", value<unsigned>(&on_ac.idle_timeout)->default_value(120))
       ("monitor.idle_timeout:battery", value<unsigned>(&on_battery.idle_timeout)->default_value(30))
 
@@ -861,41 +1863,95 @@ void monitor::settings::add_options(boost::program_options::options_description&
       ("keyboard_backlight.idle_level:ac", value<unsigned>(&on_ac.keyboard_backlight_idle_level)->default_value(0))
       ("keyboard_backlight.idle_level:battery", value<unsigned>(&on_battery.keyboard_backlight_idle_level)->default_value(0))
 
-      ("fan.hot_delay:ac", value<unsigned>(&on_ac.fan_hot_delay)->default_value(40))
-      ("fan.cold_delay:ac", value<unsigned>(&on_ac.fan_cold_delay)->default_value(20))
+      ("fan.hot_delay:ac", duration_value(&on_ac.fan_hot_delay, "40"))
+      ("fan.cold_delay:ac", duration_value(&on_ac.fan_cold_delay, "20"))
       ("fan.speed_min:ac", value<unsigned>(&on_ac.fan_speed_min)->default_value(2000))
       ("fan.speed_max:ac", value<unsigned>(&on_ac.fan_speed_max)->default_value(6500))
       ("fan.speed_delta:ac", value<unsigned>(&on_ac.fan_speed_delta)->default_value(500))
       ("fan.temp_min:ac", value<double>(&on_ac.fan_temp_min)->default_value(40.0))
       ("fan.temp_delta:ac", value<double>(&on_ac.fan_temp_delta)->default_value(5.0))
+      ("fan.mode:ac", fan_mode_value(&on_ac.fan_mode, "stepped"))
+      ("fan.curve:ac", value<std::string>(&on_ac.fan_curve_spec)->default_value(""))
+      ("fan.pid_setpoint:ac", value<double>(&on_ac.fan_pid_setpoint)->default_value(65.0))
+      ("fan.pid_kp:ac", value<double>(&on_ac.fan_pid_kp)->default_value(150.0))
+      ("fan.pid_ki:ac", value<double>(&on_ac.fan_pid_ki)->default_value(5.0))
+      ("fan.pid_kd:ac", value<double>(&on_ac.fan_pid_kd)->default_value(0.0))
+      ("fan.pid_slew:ac", value<double>(&on_ac.fan_pid_slew)->default_value(200.0))
+
+      ("fan.hot_delay:battery", duration_value(&on_battery.fan_hot_delay, "40"))
+      ("fan.cold_delay:battery", duration_value(&on_battery.fan_cold_delay, "20"))
+      ("fan.speed_min:battery", value<unsigned>(&on_battery.fan_speed_min)->default_value(2000))
+      ("fan.speed_max:battery", value<unsigned>(&on_battery.fan_speed_max)->default_value(6500))
+      ("fan.speed_delta:battery", value<unsigned>(&on_battery.fan_speed_delta)->default_value(500))
+      ("fan.temp_min:battery", value<double>(&on_battery.fan_temp_min)->default_value(40.0))
+      ("fan.temp_delta:battery", value<double>(&on_battery.fan_temp_delta)->default_value(5.0))
+      ("fan.mode:battery", fan_mode_value(&on_battery.fan_mode, "stepped"))
+      ("fan.curve:battery", value<std::string>(&on_battery.fan_curve_spec)->default_value(""))
+      ("fan.pid_setpoint:battery", value<double>(&on_battery.fan_pid_setpoint)->default_value(65.0))
+      ("fan.pid_kp:battery", value<double>(&on_battery.fan_pid_kp)->default_value(150.0))
+      ("fan.pid_ki:battery", value<double>(&on_battery.fan_pid_ki)->default_value(5.0))
+      ("fan.pid_kd:battery", value<double>(&on_battery.fan_pid_kd)->default_value(0.0))
+      ("fan.pid_slew:battery", value<double>(&on_battery.fan_pid_slew)->default_value(200.0))
+
+      ("cpu.hot_delay:ac", duration_value(&on_ac.cpu_hot_delay, "10"))
+      ("cpu.cold_delay:ac", duration_value(&on_ac.cpu_cold_delay, "20"))
+      ("cpu.temp_hot:ac", value<double>(&on_ac.cpu_temp_hot)->default_value(90.0))
+      ("cpu.temp_cold:ac", value<double>(&on_ac.cpu_temp_cold)->default_value(70.0))
+      ("cpu.throttle_delay:ac", duration_value(&on_ac.cpu_throttle_delay, "10"))
+      ("cpu.unthrottle_delay:ac", duration_value(&on_ac.cpu_unthrottle_delay, "10"))
+      ("cpu.max_speed:ac", value<unsigned>(&on_ac.cpu_max_speed)->default_value(2000000))
+
+      ("cpu.hot_delay:battery", duration_value(&on_battery.cpu_hot_delay, "10"))
+      ("cpu.cold_delay:battery", duration_value(&on_battery.cpu_cold_delay, "20"))
+      ("cpu.temp_hot:battery", value<double>(&on_battery.cpu_temp_hot)->default_value(90.0))
+      ("cpu.temp_cold:battery", value<double>(&on_battery.cpu_temp_cold)->default_value(70.0))
+      ("cpu.throttle_delay:battery", duration_value(&on_battery.cpu_throttle_delay, "10"))
+      ("cpu.unthrottle_delay:battery", duration_value(&on_battery.cpu_unthrottle_delay, "10"))
+      ("cpu.max_speed:battery", value<unsigned>(&on_battery.cpu_max_speed)->default_value(1600000))
+
+      ("powersave.min_energy_percent", value<double>(&powersave_min_energy_percent)->default_value(10.0))
+      ("powersave.min_minutes", value<double>(&powersave_min_minutes)->default_value(0.0))
+      ("powersave.cpu_max_speed", value<unsigned>(&powersave_cpu_max_speed)->default_value(1000000))
+      ;
+}
+
+void monitor::settings::compile_fan_curves()
+{
+   power_mode *modes[] = { &on_ac, &on_battery };
+
+   for (size_t i = 0; i < sizeof(modes)/sizeof(modes[0]); ++i)
+   {
+      power_mode& m = *modes[i];
+
+      if (m.fan_mode == FAN_CURVE)
+      {
+         m.fan_table.reset(new fan_curve(fan_curve::linear(fan_curve::parse(m.fan_curve_spec), m.fan_speed_min, m.fan_speed_max)));
+      }
+      else
+      {
+         m.fan_table.reset(new fan_curve(fan_curve::stepped(m.fan_temp_min, m.fan_temp_delta, m.fan_speed_min,
+                                                                  m.fan_speed_delta, m.fan_speed_max)));
+      }
+   }
+}
 
-      ("fan.hot_delay:battery", value<unsigned>(&on_battery.fan_hot_delay)->default_value(40))
-      ("fan.cold_delay:battery", value<unsigned>(&on_battery.fan_cold_delay)->default_value(20))
-      ("fan.speed_min:battery", value<unsigned>(&on_battery.fan_speed_min)->default_value(2000))
-      ("fan.speed_max:battery", value<unsigned>(&on_battery.fan_speed_max)->default_value(6500))
-      ("fan.speed_delta:battery", value<unsigned>(&on_battery.fan_speed_delta)->default_value(500))
-      ("fan.temp_min:battery", value<double>(&on_battery.fan_temp_min)->default_value(40.0))
-      ("fan.temp_delta:battery", value<double>(&on_battery.fan_temp_delta)->default_value(5.0))
+void monitor::settings::dump_fan_curves(std::ostream& os) const
+{
+   const power_mode *modes[] = { &on_ac, &on_battery };
+   const char *names[] = { "ac", "battery" };
+   const char *control[] = { "stepped", "curve", "pid" };
 
-      ("cpu.hot_delay:ac", value<unsigned>(&on_ac.cpu_hot_delay)->default_value(10))
-      ("cpu.cold_delay:ac", value<unsigned>(&on_ac.cpu_cold_delay)->default_value(20))
-      ("cpu.temp_hot:ac", value<double>(&on_ac.cpu_temp_hot)->default_value(90.0))
-      ("cpu.temp_cold:ac", value<double>(&on_ac.cpu_temp_cold)->default_value(70.0))
-      ("cpu.throttle_delay:ac", value<unsigned>(&on_ac.cpu_throttle_delay)->default_value(10))
-      ("cpu.unthrottle_delay:ac", value<unsigned>(&on_ac.cpu_unthrottle_delay)->default_value(10))
-      ("cpu.max_speed:ac", value<unsigned>(&on_ac.cpu_max_speed)->default_value(2000000))
+   for (size_t i = 0; i < sizeof(modes)/sizeof(modes[0]); ++i)
+   {
+      os << "# " << names[i] << " (" << control[modes[i]->fan_mode] << ")\n";
 
-      ("cpu.hot_delay:battery", value<unsigned>(&on_battery.cpu_hot_delay)->default_value(10))
-      ("cpu.cold_delay:battery", value<unsigned>(&on_battery.cpu_cold_delay)->default_value(20))
-      ("cpu.temp_hot:battery", value<double>(&on_battery.cpu_temp_hot)->default_value(90.0))
-      ("cpu.temp_cold:battery", value<double>(&on_battery.cpu_temp_cold)->default_value(70.0))
-      ("cpu.throttle_delay:battery", value<unsigned>(&on_battery.cpu_throttle_delay)->default_value(10))
-      ("cpu.unthrottle_delay:battery", value<unsigned>(&on_battery.cpu_unthrottle_delay)->default_value(10))
-      ("cpu.max_speed:battery", value<unsigned>(&on_battery.cpu_max_speed)->default_value(1600000))
+      if (modes[i]->fan_mode == FAN_PID)
+      {
+         os << "# not used, fan speed is controlled by pid\n";
+      }
 
-      ("powersave.min_energy_percent", value<double>(&powersave_min_energy_percent)->default_value(10.0))
-      ("powersave.cpu_max_speed", value<unsigned>(&powersave_cpu_max_speed)->default_value(1000000))
-      ;
+      modes[i]->fan_table->dump(os);
+   }
 }
 
 monitor::monitor(boost::asio::io_service& ios, root_logger& root, const settings& set)
@@ -930,21 +1986,38 @@ boost::shared_ptr<status_provider> monitor::get_status_provider()
 
 monitor_impl::monitor_impl(boost::asio::io_service& ios, root_logger& root, const monitor::settings& set)
    : m_ios(ios)
+   , m_io(ios, set.io_threads)
    , m_timer(ios)
    , m_idle_timer(ios)
-   , m_coretemp(set.hwmon_base_path)
-   , m_applesmc(set.hwmon_base_path)
+   , m_devices(set.hwmon_base_path, set.hwmon_class_path, set.device_cache, hwmon_devices())
+   , m_coretemp(m_devices)
+   , m_coretemp_sampler(m_coretemp, set.coretemp_scan_interval, set.coretemp_rescan_delta)
+   , m_applesmc(m_devices)
    , m_cpuinfo(set.cpu_base_path)
    , m_backlight(set.intel_backlight_path)
+   , m_sampled_backlight(m_backlight)
+   , m_sampled_keyboard_backlight(m_applesmc.keyboard_backlight())
    , m_ac(set.ac_path)
    , m_battery(set.battery_path)
+   , m_ac_name(boost::filesystem::path(set.ac_path).filename().native())
+   , m_display_backlight(0)
+   , m_display_backlight_set(0)
+   , m_sampler(set.sampler)
+   , m_ticks(set.check_interval, set.max_check_interval, set.quiet_temp_slope, set.quiet_load, set.temp_jump)
+   , m_power(set.power_interval, set.power_measurements)
+   , m_profile(battery_predictor::PROFILES)
+   , m_time_to_empty(-1.0)
+   , m_time_to_full(-1.0)
+   , m_low_battery(false)
+   , m_tick(set.check_interval)
+   , m_tick_pending(false)
    , m_original_display_backlight(m_backlight.brightness())
    , m_original_keyboard_backlight(m_applesmc.keyboard_backlight().brightness())
    , m_idle_level(0)
    , m_saved_display_backlight(0)
    , m_saved_keyboard_backlight(0)
    , m_on_ac(m_ac.online())
-   , m_history_size((HISTORY_LENGTH + set.check_interval - 1)/set.check_interval)
+   , m_history_size((HISTORY_LENGTH + set.check_interval - monitor::settings::duration(1))/set.check_interval)
    , m_history_count(0)
    , m_fan_temp(-300.0)
    , m_fan_hot(0.0)
@@ -958,9 +2031,110 @@ monitor_impl::monitor_impl(boost::asio::io_service& ios, root_logger& root, cons
    , m_log(root, "monitor")
    , m_stopped(true)
 {
-   m_energy_history.resize(m_history_size);
-   m_temp_history.resize(m_history_size);
+   sysfs::io_stats::set_budget(uint64_t(set.latency_budget_ms)*1000000);
+
+   m_schedule.set_period(sensor_schedule::CPU_TEMP, set.check_interval);
+   m_schedule.set_period(sensor_schedule::FAN, std::max(set.fan_interval, monitor::settings::duration(1)));
+   m_schedule.set_period(sensor_schedule::BATTERY, std::max(set.battery_interval, monitor::settings::duration(1)));
+   m_schedule.set_period(sensor_schedule::AC, std::max(set.ac_interval, monitor::settings::duration(1)));
+   m_schedule.set_period(sensor_schedule::LIGHT, std::max(set.light_interval, monitor::settings::duration(1)));
+   m_schedule.set_period(sensor_schedule::CPUFREQ, std::max(set.cpufreq_interval, monitor::settings::duration(1)));
+   m_schedule.reset(sensor_schedule::clock::now());
+
+   init_sensor_info();
+
+   m_max_temp_filter = dynamic_filter<double>(set.temp_filter);
+   m_core_filters.resize(m_info->coretemp.size());
+   m_fan_filters.resize(m_info->fan.size());
+
+   for (size_t i = 0; i < m_core_filters.size(); ++i)
+   {
+      m_core_filters[i] = dynamic_filter<double>(set.temp_filter);
+   }
+
+   for (size_t i = 0; i < m_fan_filters.size(); ++i)
+   {
+      m_fan_filters[i] = dynamic_filter<double>(set.fan_filter);
+   }
+
+   if (!m_max_temp_filter.empty())
+   {
+      double latency = m_max_temp_filter.latency();
+      LINFO(m_log, "temperature filter latency: " << latency << " samples (" << latency*set.check_interval.count()
+                   << " ms at the base check interval, more while the interval is stretched)");
+   }
+
+   m_core_channel = FIXED_CHANNELS;
+   m_fan_channel = m_core_channel + m_info->coretemp.size();
+   m_cpu_channel = m_fan_channel + m_info->fan.size();
+   m_history_values.resize(m_cpu_channel + m_info->core_id.size());
+   m_history.reset(m_history_size, m_history_values.size());
+
+   if (!set.history_file.empty())
+   {
+      try
+      {
+         m_history_file.reset(new history_file(set.history_file, m_history_size, history_channels()));
+         m_history_file->load(m_history, HISTORY_LENGTH);
+
+         if (m_history_file->reattached())
+         {
+            LINFO(m_log, "reattached " << m_history.size() << " samples from " << set.history_file);
+         }
+      }
+      catch (const std::runtime_error& e)
+      {
+         LWARN(m_log, e.what());
+      }
+   }
+
+   m_rollup.reset(new rollup(rollup::parse(set.history_tiers), m_history_values.size()));
+
+   for (size_t i = 0; i < m_history.size(); ++i)
+   {
+      for (size_t c = 0; c < m_history_values.size(); ++c)
+      {
+         m_history_values[c] = m_history.value(c, i);
+      }
+
+      m_rollup->add(m_history.time(i), m_history_values.begin());
+   }
+
+   m_history_count = reset_windows();
+
+   if (set.power_supply_events)
+   {
+      try
+      {
+         m_power_watcher.reset(new uevent_watcher(ios, root, uevent_watcher::open_netlink()));
+      }
+      catch (const std::runtime_error& e)
+      {
+         LWARN(m_log, e.what() << ", polling AC state instead");
+      }
+   }
 
+   if (set.watch_attributes)
+   {
+      m_backlight_watch.reset(new sysfs::attribute_watch(ios, boost::filesystem::path(set.intel_backlight_path) / "actual_brightness"));
+   }
+
+   // the adaptive sampler reads single sensors, batching them all is pointless
+   if (!m_coretemp_sampler.adaptive())
+   {
+      m_coretemp.add_samples(m_sampler, sensor_schedule::CPU_TEMP);
+   }
+   m_applesmc.add_samples(m_sampler, sensor_schedule::FAN);
+   m_battery.add_energy_sample(m_sampler, sensor_schedule::BATTERY);
+
+   if (!m_power_watcher)
+   {
+      m_ac.add_online_sample(m_sampler, sensor_schedule::AC);
+   }
+
+   LINFO(m_log, "sampling " << m_sampler.size() << " attributes using " << m_sampler.backend());
+
+   LINFO(m_log, "device discovery took " << 1e3*m_devices.elapsed() << " ms (" << m_devices.source() << ")");
    LINFO(m_log, "coretemp path: " << m_coretemp.path());
    LINFO(m_log, "applesmc path: " << m_applesmc.path());
 }
@@ -968,6 +2142,38 @@ monitor_impl::monitor_impl(boost::asio::io_service& ios, root_logger& root, cons
 void monitor_impl::start()
 {
    m_stopped = false;
+
+   // applies to the thread running the io_service, i.e. this one
+   if (m_set.timer_slack > monitor::settings::duration::zero())
+   {
+      unsigned long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(m_set.timer_slack).count();
+
+      if (::prctl(PR_SET_TIMERSLACK, ns, 0, 0, 0) != 0)
+      {
+         LWARN(m_log, "cannot set timer slack: " << ::strerror(errno));
+      }
+   }
+
+   if (m_backlight_watch && !m_backlight_watch->start(boost::bind(&monitor_impl::on_backlight_changed, shared_from_this(), _1, _2)))
+   {
+      LINFO(m_log, "cannot watch " << m_backlight_watch->path() << ", polling instead");
+      m_backlight_watch.reset();
+   }
+
+   try
+   {
+      publish_snapshot(take_snapshot(m_on_ac, m_schedule.due(sensor_schedule::clock::now()), m_snapshot));
+   }
+   catch (const std::runtime_error& e)
+   {
+      LWARN(m_log, e.what());
+   }
+
+   if (m_power_watcher)
+   {
+      m_power_watcher->start(boost::bind(&monitor_impl::on_power_supply_event, shared_from_this(), _1));
+   }
+
    restart_periodic_check();
    restart_idle();
 }
@@ -979,6 +2185,17 @@ void monitor_impl::stop()
       m_stopped = true;
       m_timer.cancel();
       m_idle_timer.cancel();
+      m_io.stop();
+
+      if (m_power_watcher)
+      {
+         m_power_watcher->stop();
+      }
+
+      if (m_backlight_watch)
+      {
+         m_backlight_watch->stop();
+      }
    }
 }
 
@@ -993,7 +2210,7 @@ void monitor_impl::ensure_safe_defaults()
 
    if (m_backlight.brightness() < backlight)
    {
-      m_backlight.set_brightness(backlight);
+      set_display_backlight(backlight);
    }
 
    if (keyboard_backlight.brightness() < m_original_keyboard_backlight)
@@ -1004,24 +2221,278 @@ void monitor_impl::ensure_safe_defaults()
 
 void monitor_impl::restart_periodic_check()
 {
-   m_timer.expires_from_now(boost::posix_time::seconds(m_set.check_interval));
+   sensor_schedule::clock::time_point next = m_schedule.next();
+
+   // round long waits up to a whole second, where other timers tend to be
+   if (m_set.align_wakeups && next - sensor_schedule::clock::now() >= std::chrono::seconds(1))
+   {
+      sensor_schedule::clock::duration since_epoch = next.time_since_epoch();
+      sensor_schedule::clock::duration rem = since_epoch % std::chrono::seconds(1);
+
+      if (rem != sensor_schedule::clock::duration::zero())
+      {
+         next += std::chrono::seconds(1) - rem;
+      }
+   }
+
+   m_timer.expires_at(next);
    m_timer.async_wait(boost::bind(&monitor_impl::on_periodic_check, shared_from_this(), boost::asio::placeholders::error));
 }
 
+// go back to the base period, so the next check happens soon
+void monitor_impl::wake_periodic_check()
+{
+   if (m_ticks.wake())
+   {
+      sensor_schedule::clock::time_point next = sensor_schedule::clock::now() + m_set.check_interval;
+
+      m_schedule.set_period(sensor_schedule::CPU_TEMP, m_set.check_interval);
+      m_schedule.set_deadline(sensor_schedule::CPU_TEMP, std::min(next, m_schedule.deadline(sensor_schedule::CPU_TEMP)));
+
+      // otherwise the running tick will pick up the new deadline
+      if (!m_tick_pending && !m_stopped)
+      {
+         restart_periodic_check();
+      }
+   }
+}
+
 void monitor_impl::restart_idle()
 {
-   m_idle_timer.expires_from_now(boost::posix_time::seconds(power_settings().idle_timeout));
+   m_idle_timer.expires_from_now(std::chrono::seconds(power_settings().idle_timeout));
    m_idle_timer.async_wait(boost::bind(&monitor_impl::on_idle, shared_from_this(), boost::asio::placeholders::error));
 }
 
-void monitor_impl::update_stats()
+void monitor_impl::init_sensor_info()
+{
+   boost::shared_ptr<sensor_info> info(new sensor_info);
+
+   for (coretemp::const_iterator it = m_coretemp.begin(); it != m_coretemp.end(); ++it)
+   {
+      sensor_info::temp_sensor t;
+      t.label = it->label();
+      t.max = it->max();
+      t.crit = it->crit();
+      info->coretemp.push_back(t);
+   }
+
+   for (applesmc::const_fan_iterator it = m_applesmc.fan_begin(); it != m_applesmc.fan_end(); ++it)
+   {
+      info->fan.push_back(it->label());
+   }
+
+   for (cpuinfo::const_iterator it = m_cpuinfo.begin(); it != m_cpuinfo.end(); ++it)
+   {
+      info->core_id.push_back(it->core_id());
+   }
+
+   info->cpu_configurable = m_cpuinfo.configurable();
+
+   if (info->cpu_configurable)
+   {
+      m_cpuinfo.scaling_available_frequencies(std::back_inserter(info->available_frequencies));
+      std::sort(info->available_frequencies.begin(), info->available_frequencies.end());
+   }
+
+   info->has_palm_rest = m_applesmc.has_temp("Ts0P");
+   info->display_backlight_max = m_backlight.max_brightness();
+   info->keyboard_backlight_max = m_applesmc.keyboard_backlight().max_brightness();
+
+   m_info = info;
+}
+
+boost::shared_ptr<sensor_snapshot> monitor_impl::take_snapshot(bool on_ac, uint32_t groups, boost::shared_ptr<const sensor_snapshot> prev)
+{
+   // groups that are not due keep their values from the last snapshot
+   if (!prev)
+   {
+      groups = ~uint32_t(0);
+   }
+
+   m_sampler.sample(groups);
+
+   boost::shared_ptr<sensor_snapshot> snap(prev ? new sensor_snapshot(*prev) : new sensor_snapshot);
+
+   snap->info = m_info;
+
+   if (groups & sensor_schedule::mask(sensor_schedule::CPU_TEMP))
+   {
+      snap->max_temp = m_coretemp_sampler.sample();
+      snap->coretemp = m_coretemp_sampler.values();
+      snap->coretemp_stats = m_coretemp_sampler.get_stats();
+      snap->palm_rest_temp = m_info->has_palm_rest ? m_applesmc.get_temp("Ts0P").input() : 0.0;
+      snap->load = m_loadavg.value();
+   }
+
+   snap->fan.resize(m_applesmc.fan_end() - m_applesmc.fan_begin());
+
+   for (applesmc::const_fan_iterator it = m_applesmc.fan_begin(); it != m_applesmc.fan_end(); ++it)
+   {
+      sensor_snapshot::fan_state& f = snap->fan[it - m_applesmc.fan_begin()];
+
+      if (groups & sensor_schedule::mask(sensor_schedule::FAN))
+      {
+         f.input = it->input();
+      }
+
+      f.output = it->output();
+      f.manual = it->manual();
+   }
+
+   if (groups & sensor_schedule::mask(sensor_schedule::LIGHT))
+   {
+      snap->ambient_light = m_applesmc.ambient_light().value();
+      snap->keyboard_backlight = m_sampled_keyboard_backlight.brightness();
+
+      if (!m_backlight_watch)
+      {
+         snap->display_backlight = m_sampled_backlight.actual_brightness();
+      }
+   }
+
+   snap->scaling_max_freq = 0;
+   snap->cpu.resize(m_cpuinfo.end() - m_cpuinfo.begin());
+
+   for (cpuinfo::const_iterator it = m_cpuinfo.begin(); it != m_cpuinfo.end(); ++it)
+   {
+      sensor_snapshot::cpu_state& c = snap->cpu[it - m_cpuinfo.begin()];
+
+      if (groups & sensor_schedule::mask(sensor_schedule::CPUFREQ))
+      {
+         c.scaling_cur_freq = it->scaling_cur_freq();
+         c.scaling_governor = it->scaling_governor();
+      }
+
+      // this is what we wrote, so it is always up to date
+      c.scaling_max_freq = it->scaling_max_freq();
+      snap->scaling_max_freq = std::max(snap->scaling_max_freq, c.scaling_max_freq);
+   }
+
+   if (m_power_watcher)
+   {
+      snap->on_ac = on_ac;
+   }
+   else if (groups & sensor_schedule::mask(sensor_schedule::AC))
+   {
+      snap->on_ac = m_ac.online();
+   }
+
+   if (groups & sensor_schedule::mask(sensor_schedule::BATTERY))
+   {
+      snap->energy_now = m_battery.energy_now();
+      snap->energy_full = m_battery.energy_full();
+      snap->power_now = snap->on_ac ? 0.0 : m_battery.power_now();
+   }
+
+   return snap;
+}
+
+void monitor_impl::update_stats(size_t slots)
+{
+   set_power_mode(m_snapshot->on_ac);
+
+   const sensor_snapshot& snap = *m_snapshot;
+   std::vector<double>& v = m_history_values;
+
+   v[MAX_TEMP] = snap.max_temp;
+   v[ENERGY_NOW] = snap.energy_now;
+   v[POWER_NOW] = snap.power_now;
+   v[DISPLAY_BACKLIGHT] = snap.display_backlight;
+   v[KEYBOARD_BACKLIGHT] = snap.keyboard_backlight;
+   v[AMBIENT_LIGHT] = snap.ambient_light;
+   std::copy(snap.coretemp.begin(), snap.coretemp.end(), v.begin() + m_core_channel);
+
+   for (size_t i = 0; i < snap.fan.size(); ++i)
+   {
+      v[m_fan_channel + i] = snap.fan[i].input;
+   }
+
+   for (size_t i = 0; i < snap.cpu.size(); ++i)
+   {
+      v[m_cpu_channel + i] = snap.cpu[i].scaling_cur_freq;
+   }
+
+   m_history.push(time_series<double>::clock::now(), v.begin());
+   m_rollup->add(m_history.back_time(), v.begin(), slots);
+
+   if (m_history_file)
+   {
+      m_history_file->append(m_history);
+   }
+
+   // a stretched tick fills all the window slots it covers
+   for (size_t i = 0; i < slots; ++i)
+   {
+      ++m_history_count;
+
+      m_fan_hot_window.push(m_snapshot->max_temp);
+      m_fan_cold_window.push(m_snapshot->max_temp);
+      m_cpu_hot_window.push(m_snapshot->max_temp);
+      m_cpu_cold_window.push(m_snapshot->max_temp);
+   }
+}
+
+std::vector<std::string> monitor_impl::history_channels() const
+{
+   static const char * const fixed[FIXED_CHANNELS] = {
+      "max_temp", "energy_now", "power_now", "display_backlight", "keyboard_backlight", "ambient_light"
+   };
+
+   std::vector<std::string> names(fixed, fixed + FIXED_CHANNELS);
+
+   for (size_t i = 0; i < m_info->coretemp.size(); ++i)
+   {
+      names.push_back(std::string(attribute_name("core", i, "temp")));
+   }
+
+   for (size_t i = 0; i < m_info->fan.size(); ++i)
+   {
+      names.push_back(std::string(attribute_name("fan", i + 1, "input")));
+   }
+
+   for (size_t i = 0; i < m_info->core_id.size(); ++i)
+   {
+      names.push_back(std::string(attribute_name("cpu", i, "freq")));
+   }
+
+   return names;
+}
+
+size_t monitor_impl::reset_windows()
 {
-   m_on_ac = m_ac.online();
+   const monitor::settings::power_mode& power_set = power_settings();
 
-   size_t index = ++m_history_count % m_history_size;
+   m_fan_hot_window.reset(power_set.fan_hot_delay/m_set.check_interval + 1);
+   m_fan_cold_window.reset(power_set.fan_cold_delay/m_set.check_interval + 1);
+   m_cpu_hot_window.reset(power_set.cpu_hot_delay/m_set.check_interval + 1);
+   m_cpu_cold_window.reset(power_set.cpu_cold_delay/m_set.check_interval + 1);
 
-   m_temp_history[index] = m_coretemp.current_max_temp();
-   m_energy_history[index] = m_battery.energy_now();
+   // refill from the history, the windows of the other power mode differ
+   size_t count = 0;
+
+   for (size_t i = 0; i < m_history.size(); ++i)
+   {
+      double t = m_history.value(MAX_TEMP, i);
+      size_t slots = 1;
+
+      if (i > 0)
+      {
+         time_series<double>::clock::duration gap = m_history.time(i) - m_history.time(i - 1);
+         slots = std::max<size_t>(1, std::min<size_t>(m_history_size, (gap + m_set.check_interval/2)/m_set.check_interval));
+      }
+
+      for (size_t j = 0; j < slots; ++j)
+      {
+         m_fan_hot_window.push(t);
+         m_fan_cold_window.push(t);
+         m_cpu_hot_window.push(t);
+         m_cpu_cold_window.push(t);
+      }
+
+      count += slots;
+   }
+
+   return count;
 }
 
 void monitor_impl::check_fan()
@@ -1030,26 +2501,105 @@ void monitor_impl::check_fan()
 
    if (m_fan_hot > m_fan_temp)
    {
-      m_fan_temp = m_fan_hot;
+      m_fan_temp = m_fan_hot;
+   }
+   else if (m_fan_cold < m_fan_temp)
+   {
+      m_fan_temp = m_fan_cold;
+   }
+
+   unsigned fan_speed;
+
+   if (power_set.fan_mode == monitor::settings::FAN_PID)
+   {
+      // a tick after suspend or a restart may cover minutes
+      double dt = std::chrono::duration<double>(std::min(m_tick, m_set.max_check_interval)).count();
+
+      if (!m_fan_pid.running() && !m_snapshot->fan.empty())
+      {
+         m_fan_pid.reset(m_snapshot->fan.front().output);
+      }
+
+      fan_speed = static_cast<unsigned>(std::lround(m_fan_pid.update(power_set, m_snapshot->max_temp, dt)));
+   }
+   else
+   {
+      fan_speed = (*power_set.fan_table)(m_fan_temp);
+   }
+
+   LDEBUG(m_log, "fan_speed=" << fan_speed);
+
+   m_applesmc.set_fan_speed(fan_speed);
+}
+
+size_t monitor_impl::current_profile() const
+{
+   unsigned max_speed = power_settings().cpu_max_speed;
+
+   if (!m_info->available_frequencies.empty())
+   {
+      max_speed = std::min(max_speed, m_info->available_frequencies.back());
+   }
+
+   return battery_predictor::profile(m_snapshot->on_ac, m_idle_level, m_snapshot->scaling_max_freq < max_speed);
+}
+
+void monitor_impl::update_prediction()
+{
+   const sensor_snapshot& snap = *m_snapshot;
+   size_t profile = current_profile();
+   time_series<double>::clock::time_point now = time_series<double>::clock::now();
+   double power;
+
+   if (profile != m_profile)
+   {
+      m_profile = profile;
+      m_profile_since = now;
+   }
+
+   // the fit window must not reach back into the previous profile
+   bool settled = now - m_profile_since >= m_set.power_interval;
+
+   if (m_power.valid() && settled)
+   {
+      m_predictor.learn(profile, m_power.power());
    }
-   else if (m_fan_cold < m_fan_temp)
+
+   m_time_to_empty = m_time_to_full = -1.0;
+
+   if (m_predictor.predict(profile, m_power, settled, power))
    {
-      m_fan_temp = m_fan_cold;
+      if (!snap.on_ac && power > 0.0)
+      {
+         m_time_to_empty = 3600.0*snap.energy_now/power;
+      }
+      else if (snap.on_ac && power < 0.0 && snap.energy_full > snap.energy_now)
+      {
+         m_time_to_full = 3600.0*(snap.energy_full - snap.energy_now)/-power;
+      }
    }
 
-   unsigned fan_ix = (m_fan_temp - power_set.fan_temp_min)/power_set.fan_temp_delta;
-   unsigned fan_speed = std::min(power_set.fan_speed_min + fan_ix*power_set.fan_speed_delta, power_set.fan_speed_max);
-
-   LDEBUG(m_log, "fan_speed=" << fan_speed);
+   // stays on until plugged in, as powersave itself stretches the prediction
+   if (snap.on_ac)
+   {
+      m_low_battery = false;
+   }
+   else if (m_set.powersave_min_minutes > 0.0 && m_time_to_empty >= 0.0 && m_time_to_empty < 60.0*m_set.powersave_min_minutes)
+   {
+      if (!m_low_battery)
+      {
+         LINFO(m_log, "less than " << m_set.powersave_min_minutes << " minutes of battery left, enabling powersave");
+      }
 
-   m_applesmc.set_fan_speed(fan_speed);
+      m_low_battery = true;
+   }
 }
 
 unsigned monitor_impl::cpu_max_speed() const
 {
    if (!m_on_ac)
    {
-      if (100.0*m_battery.energy_now()/m_battery.energy_full() < m_set.powersave_min_energy_percent)
+      if (m_low_battery || 100.0*m_snapshot->energy_now/m_snapshot->energy_full < m_set.powersave_min_energy_percent)
       {
          return m_set.powersave_cpu_max_speed;
       }
@@ -1074,7 +2624,7 @@ void monitor_impl::check_cpu()
    bool throttle = false;
    bool unthrottle = false;
 
-   if (m_cpu_throttle_time == 0)
+   if (m_cpu_throttle_time == monitor::settings::duration::zero())
    {
       if (m_cpu_temp > power_set.cpu_temp_hot)
       {
@@ -1083,17 +2633,17 @@ void monitor_impl::check_cpu()
    }
    else
    {
-      if (m_cpu_throttle_time > m_set.check_interval)
+      if (m_cpu_throttle_time > m_tick)
       {
-         m_cpu_throttle_time -= m_set.check_interval;
+         m_cpu_throttle_time -= m_tick;
       }
       else
       {
-         m_cpu_throttle_time = 0;
+         m_cpu_throttle_time = monitor::settings::duration::zero();
       }
    }
 
-   if (m_cpu_unthrottle_time == 0)
+   if (m_cpu_unthrottle_time == monitor::settings::duration::zero())
    {
       if (m_cpu_temp < power_set.cpu_temp_cold)
       {
@@ -1102,21 +2652,19 @@ void monitor_impl::check_cpu()
    }
    else
    {
-      if (m_cpu_unthrottle_time > m_set.check_interval)
+      if (m_cpu_unthrottle_time > m_tick)
       {
-         m_cpu_unthrottle_time -= m_set.check_interval;
+         m_cpu_unthrottle_time -= m_tick;
       }
       else
       {
-         m_cpu_unthrottle_time = 0;
+         m_cpu_unthrottle_time = monitor::settings::duration::zero();
       }
    }
 
-   std::vector<unsigned> available;
-   m_cpuinfo.scaling_available_frequencies(std::back_inserter(available));
-   std::sort(available.begin(), available.end());
+   const std::vector<unsigned>& available = m_info->available_frequencies;
 
-   unsigned current = m_cpuinfo.scaling_max_freq();
+   unsigned current = m_snapshot->scaling_max_freq;
    size_t ix = std::lower_bound(available.begin(), available.end(), current) - available.begin();
    size_t max_ix = std::lower_bound(available.begin(), available.end(), cpu_max_speed()) - available.begin();
    if (max_ix >= available.size())
@@ -1141,7 +2689,7 @@ void monitor_impl::check_cpu()
       }
    }
 
-   LDEBUG(m_log, "throttle_time=" << m_cpu_throttle_time << ", unthrottle_time=" << m_cpu_unthrottle_time << ", cpu_temp=" << m_cpu_temp);
+   LDEBUG(m_log, "throttle_time=" << m_cpu_throttle_time.count() << "ms, unthrottle_time=" << m_cpu_unthrottle_time.count() << "ms, cpu_temp=" << m_cpu_temp);
    LDEBUG(m_log, "throttle=" << throttle << ", unthrottle=" << unthrottle << ", ix: " << ix << " -> " << new_ix << " (" << available[ix] << " -> " << available[new_ix] << ")");
 
    if (new_ix != ix)
@@ -1163,40 +2711,15 @@ void monitor_impl::run_checks()
 {
    const monitor::settings::power_mode& power_set = power_settings();
 
-   unsigned delay = std::max(std::max(power_set.fan_hot_delay, power_set.fan_cold_delay),
-                             std::max(power_set.cpu_hot_delay, power_set.cpu_cold_delay));
+   monitor::settings::duration delay = std::max(std::max(power_set.fan_hot_delay, power_set.fan_cold_delay),
+                                                std::max(power_set.cpu_hot_delay, power_set.cpu_cold_delay));
 
-   if (delay/m_set.check_interval < m_history_count)
+   if (size_t(delay/m_set.check_interval) < m_history_count)
    {
-      double fan_cold = -300.0;
-      double fan_hot = 1000.0;
-      double cpu_cold = -300.0;
-      double cpu_hot = 1000.0;
-
-      for (unsigned i = 0, dt = 0; dt <= delay; ++i, dt += m_set.check_interval)
-      {
-         double t = m_temp_history[(m_history_count - i) % m_history_size];
-
-         if (dt <= power_set.fan_hot_delay)
-         {
-            fan_hot = std::min(fan_hot, t);
-         }
-
-         if (dt <= power_set.fan_cold_delay)
-         {
-            fan_cold = std::max(fan_cold, t);
-         }
-
-         if (dt <= power_set.cpu_hot_delay)
-         {
-            cpu_hot = std::min(cpu_hot, t);
-         }
-
-         if (dt <= power_set.cpu_cold_delay)
-         {
-            cpu_cold = std::max(cpu_cold, t);
-         }
-      }
+      double fan_hot = m_fan_hot_window.value();
+      double fan_cold = m_fan_cold_window.value();
+      double cpu_hot = m_cpu_hot_window.value();
+      double cpu_cold = m_cpu_cold_window.value();
 
       LDEBUG(m_log, "fan_hot=" << fan_hot << ", fan_cold=" << fan_cold << ", cpu_hot=" << cpu_hot << ", cpu_cold=" << cpu_cold);
 
@@ -1217,30 +2740,255 @@ void monitor_impl::run_checks()
       }
 
       check_fan();
-      if (m_cpuinfo.configurable()) {
+      if (m_info->cpu_configurable) {
         check_cpu();
       }
    }
 }
 
+size_t monitor_impl::commit_changes(bool verify)
+{
+   return m_applesmc.commit(verify) + m_cpuinfo.commit(verify);
+}
+
+// only freshly read groups are filtered, the others were copied from the last snapshot
+void monitor_impl::filter_snapshot(sensor_snapshot& snap, uint32_t groups)
+{
+   if (groups & sensor_schedule::mask(sensor_schedule::CPU_TEMP))
+   {
+      snap.max_temp = m_max_temp_filter(snap.max_temp);
+
+      for (size_t i = 0; i < snap.coretemp.size() && i < m_core_filters.size(); ++i)
+      {
+         snap.coretemp[i] = m_core_filters[i](snap.coretemp[i]);
+      }
+   }
+
+   if (groups & sensor_schedule::mask(sensor_schedule::FAN))
+   {
+      for (size_t i = 0; i < snap.fan.size() && i < m_fan_filters.size(); ++i)
+      {
+         snap.fan[i].input = m_fan_filters[i](snap.fan[i].input);
+      }
+   }
+}
+
+// fills in the values that are tracked through events rather than read
+void monitor_impl::publish_snapshot(boost::shared_ptr<sensor_snapshot> snap)
+{
+   if (m_backlight_watch)
+   {
+      snap->display_backlight = m_display_backlight;
+   }
+
+   m_snapshot = snap;
+}
+
+void monitor_impl::on_backlight_changed(const char *buf, size_t len)
+{
+   unsigned brightness;
+
+   try
+   {
+      brightness = sysfs::value_traits<unsigned>::parse(buf, buf + len);
+   }
+   catch (const std::exception& e)
+   {
+      LWARN(m_log, "cannot parse display backlight: " << e.what());
+      return;
+   }
+
+   LDEBUG(m_log, "display backlight changed: " << m_display_backlight << " -> " << brightness);
+
+   m_display_backlight = brightness;
+
+   // someone else changed the brightness while we had it dimmed, so
+   // don't restore the old level later on
+   if (m_idle_level == 1 && brightness != m_display_backlight_set)
+   {
+      LINFO(m_log, "external display backlight change, leaving idle");
+      m_idle_level = 0;
+      restart_idle();
+   }
+}
+
+/*
+ * A tick is split into three steps, so that no sysfs I/O happens on the
+ * io_service thread: sensors are read on the I/O pool, the checks run
+ * on the io_service thread and only stage new actuator values, and the
+ * staged values are committed on the I/O pool again. The next tick is
+ * only scheduled once the commit is done, so the pool never touches the
+ * sensor objects while a check is running.
+ */
 void monitor_impl::on_periodic_check(const boost::system::error_code& e)
 {
    if (e != boost::asio::error::operation_aborted)
    {
-      try
+      m_tick_start = sensor_schedule::clock::now();
+      m_wakeups.push_back(m_tick_start);
+
+      while (m_wakeups.front() < m_tick_start - std::chrono::minutes(1))
+      {
+         m_wakeups.pop_front();
+      }
+      m_tick_pending = true;
+      m_tick_deadline = m_schedule.deadline(sensor_schedule::CPU_TEMP);
+
+      uint32_t groups = m_schedule.due(m_tick_start);
+
+      m_io.async< boost::shared_ptr<sensor_snapshot> >(
+         boost::bind(&monitor_impl::take_snapshot, shared_from_this(), m_on_ac, groups, m_snapshot),
+         boost::bind(&monitor_impl::on_snapshot, shared_from_this(), _1, _2, groups));
+   }
+}
+
+void monitor_impl::on_snapshot(std::exception_ptr error, boost::shared_ptr<sensor_snapshot> snap, uint32_t groups)
+{
+   // the control loop only runs along with the temperature sensors
+   bool control = groups & sensor_schedule::mask(sensor_schedule::CPU_TEMP);
+
+   try
+   {
+      if (error)
+      {
+         std::rethrow_exception(error);
+      }
+
+      // the AC state may have changed through an event while this snapshot was taken
+      if (m_power_watcher)
+      {
+         snap->on_ac = m_on_ac;
+      }
+
+      bool prev_on_ac = m_snapshot ? m_snapshot->on_ac : snap->on_ac;
+
+      filter_snapshot(*snap, groups);
+      publish_snapshot(snap);
+
+      // a fit across plugging or unplugging makes no sense
+      if (prev_on_ac != snap->on_ac)
+      {
+         m_power.reset();
+      }
+
+      if (groups & sensor_schedule::mask(sensor_schedule::BATTERY))
       {
-         update_stats();
+         m_power.add(time_series<double>::clock::now(), snap->energy_now);
+         update_prediction();
+      }
+
+      if (control)
+      {
+         sensor_schedule::clock::time_point now = sensor_schedule::clock::now();
+         sensor_schedule::clock::duration elapsed = m_last_control != sensor_schedule::clock::time_point() ? now - m_last_control : m_set.check_interval;
+
+         // the history may predate this process, the gap is filled with the current value
+         time_series<double>::clock::duration gap = m_history.empty() ? m_set.check_interval
+                                                  : time_series<double>::clock::now() - m_history.back_time();
+         size_t slots = std::max<size_t>(1, std::min<size_t>(m_history_size, (gap + m_set.check_interval/2)/m_set.check_interval));
+
+         m_last_control = now;
+         m_tick = slots*m_set.check_interval;
+
+         update_stats(slots);
          run_checks();
+
+         monitor::settings::duration interval = m_ticks.update(snap->max_temp, snap->load, m_idle_level == 2,
+                                                               std::chrono::duration_cast<monitor::settings::duration>(elapsed));
+         // count from the deadline rather than the wakeup, so timer slack doesn't accumulate
+         m_schedule.set_period(sensor_schedule::CPU_TEMP, interval);
+         m_schedule.set_deadline(sensor_schedule::CPU_TEMP, std::max(m_tick_deadline + interval, now));
       }
-      catch (const std::runtime_error& e)
+   }
+   catch (const std::exception& e)
+   {
+      LWARN(m_log, e.what());
+   }
+
+   if (m_stopped)
+   {
+      return;
+   }
+
+   if (!control)
+   {
+      m_tick_pending = false;
+      restart_periodic_check();
+      return;
+   }
+
+   sensor_schedule::clock::time_point now = sensor_schedule::clock::now();
+   bool verify = now >= m_next_verify;
+
+   if (verify)
+   {
+      m_next_verify = now + m_set.actuator_verify_interval;
+   }
+
+   m_io.async<size_t>(
+      boost::bind(&monitor_impl::commit_changes, shared_from_this(), verify),
+      boost::bind(&monitor_impl::on_commit, shared_from_this(), _1, _2));
+}
+
+void monitor_impl::on_commit(std::exception_ptr error, size_t writes)
+{
+   try
+   {
+      if (error)
       {
-         LWARN(m_log, e.what());
+         std::rethrow_exception(error);
       }
 
+      if (writes > 0)
+      {
+         LDEBUG(m_log, writes << " attribute(s) written");
+      }
+   }
+   catch (const std::exception& e)
+   {
+      LWARN(m_log, e.what());
+   }
+
+   m_tick_pending = false;
+
+   if (!m_stopped)
+   {
       restart_periodic_check();
    }
 }
 
+void monitor_impl::on_power_supply_event(const power_supply_event& ev)
+{
+   if (ev.name.empty())
+   {
+      // the handler keeps us alive until the read is done
+      m_io.async<bool>(
+         boost::bind(&power::online, &m_ac),
+         boost::bind(&monitor_impl::on_ac_resync, shared_from_this(), _1, _2));
+   }
+   else if (ev.name == m_ac_name && ev.online >= 0)
+   {
+      set_power_mode(ev.online > 0);
+   }
+}
+
+void monitor_impl::on_ac_resync(std::exception_ptr error, bool online)
+{
+   try
+   {
+      if (error)
+      {
+         std::rethrow_exception(error);
+      }
+
+      set_power_mode(online);
+   }
+   catch (const std::exception& e)
+   {
+      LERROR(m_log, "cannot resync AC state: " << e.what());
+   }
+}
+
 void monitor_impl::on_idle(const boost::system::error_code& e)
 {
    if (e != boost::asio::error::operation_aborted)
@@ -1283,10 +3031,16 @@ void monitor_impl::set_display_brightness(bool up, bool slow)
 
    if (brightness != cur)
    {
-      m_backlight.set_brightness(brightness);
+      set_display_backlight(brightness);
    }
 }
 
+void monitor_impl::set_display_backlight(unsigned brightness)
+{
+   m_display_backlight_set = brightness;
+   m_backlight.set_brightness(brightness);
+}
+
 void monitor_impl::set_keyboard_brightness(bool up, bool slow)
 {
    const led& backlight = m_applesmc.keyboard_backlight();
@@ -1306,6 +3060,31 @@ const monitor::settings::power_mode& monitor_impl::power_settings() const
    return m_on_ac ? m_set.on_ac : m_set.on_battery;
 }
 
+void monitor_impl::set_power_mode(bool on_ac)
+{
+   if (on_ac != m_on_ac)
+   {
+      LINFO(m_log, "running on " << (on_ac ? "AC" : "battery"));
+
+      m_on_ac = on_ac;
+
+      reset_windows();
+
+      if (m_snapshot && !m_snapshot->fan.empty())
+      {
+         m_fan_pid.reset(m_snapshot->fan.front().output);
+      }
+
+      // apply the limits of the new mode right away
+      wake_periodic_check();
+
+      if (m_idle_level == 0 && !m_stopped)
+      {
+         restart_idle();
+      }
+   }
+}
+
 void monitor_impl::enter_idle(unsigned level)
 {
    LDEBUG(m_log, "enter_idle(" << level << ")");
@@ -1332,7 +3111,7 @@ void monitor_impl::enter_idle(unsigned level)
 
       if (display_target < display_current)
       {
-         m_backlight.set_brightness(display_target);
+         set_display_backlight(display_target);
       }
 
       if (keyboard_target < keyboard_current)
@@ -1350,7 +3129,7 @@ void monitor_impl::leave_idle()
    {
       LDEBUG(m_log, "leave_idle() [" << m_idle_level << ", " << m_saved_display_backlight << ", " << m_saved_keyboard_backlight << "]");
 
-      m_backlight.set_brightness(m_saved_display_backlight);
+      set_display_backlight(m_saved_display_backlight);
       m_applesmc.keyboard_backlight().set_brightness(m_saved_keyboard_backlight);
       m_idle_level = 0;
    }
@@ -1360,40 +3139,216 @@ void monitor_impl::leave_idle()
 
 double monitor_impl::current_power() const
 {
-   size_t delta = m_set.power_interval/m_set.check_interval;
+   return m_power.valid() ? m_power.power() : 0.0;
+}
+
+void monitor_impl::query(const std::string& request, std::ostream& os) const
+{
+   std::istringstream is(request);
+   std::string cmd;
 
-   if (m_history_count <= delta + m_set.power_measurements)
+   is >> cmd;
+
+   if (cmd.empty() || cmd == "status")
    {
-      return 0.0;
+      status(os);
    }
+   else if (cmd == "channels")
+   {
+      std::vector<std::string> names = history_channels();
 
-   double old = 0.0, now = 0.0;
-
-   for (size_t i = 0; i < m_set.power_measurements; ++i)
+      for (size_t i = 0; i < names.size(); ++i)
+      {
+         os << i << " " << names[i] << "\n";
+      }
+   }
+   else if (cmd == "tiers")
    {
-      now += m_energy_history[(m_history_count - i) % m_history_size];
-      old += m_energy_history[(m_history_count - (delta + i)) % m_history_size];
+      for (size_t i = 0; i < m_rollup->tiers(); ++i)
+      {
+         const rollup::tier& t = m_rollup->get_tier(i);
+         os << i << " " << std::chrono::duration_cast<std::chrono::seconds>(t.resolution).count() << "s "
+            << std::chrono::duration_cast<std::chrono::seconds>(t.span).count() << "s "
+            << m_rollup->series(i).size() << "/" << m_rollup->series(i).capacity() << "\n";
+      }
    }
+   else if (cmd == "history")
+   {
+      // history <tier> [<channel>...], prints age in seconds and min/avg/max per channel
+      std::vector<std::string> names = history_channels();
+      std::vector<size_t> channels;
+      size_t tier;
+      std::string name;
+
+      if (!(is >> tier) || tier >= m_rollup->tiers())
+      {
+         throw std::runtime_error("invalid tier");
+      }
+
+      while (is >> name)
+      {
+         std::vector<std::string>::const_iterator it = std::find(names.begin(), names.end(), name);
+
+         if (it == names.end())
+         {
+            throw std::runtime_error("unknown channel: " + name);
+         }
+
+         channels.push_back(it - names.begin());
+      }
+
+      if (channels.empty())
+      {
+         channels.push_back(MAX_TEMP);
+      }
+
+      const rollup::series_type& series = m_rollup->series(tier);
+      rollup::time_point now = rollup::series_type::clock::now();
+
+      for (size_t i = 0; i < series.size(); ++i)
+      {
+         os << std::chrono::duration_cast<std::chrono::seconds>(now - series.time(i)).count();
+
+         for (size_t j = 0; j < channels.size(); ++j)
+         {
+            os << " " << series.value(rollup::channel(channels[j], rollup::MIN), i)
+               << "/" << series.value(rollup::channel(channels[j], rollup::AVG), i)
+               << "/" << series.value(rollup::channel(channels[j], rollup::MAX), i);
+         }
 
-   return 3600.0*(old - now)/(m_set.power_measurements*m_set.power_interval);
+         os << "\n";
+      }
+   }
+   else
+   {
+      throw std::runtime_error("unknown request: " + cmd);
+   }
 }
 
 void monitor_impl::status(std::ostream& os) const
 {
-   m_coretemp.dump(os);
-   m_applesmc.dump(os);
-   m_cpuinfo.dump(os);
-   os << "Display Backlight: " << m_backlight.actual_brightness() << "/" << m_backlight.max_brightness() << "\n";
+   if (!m_snapshot)
+   {
+      os << "no sensor data available yet\n";
+      return;
+   }
+
+   m_snapshot->dump(os);
    os << "Running on " << (m_on_ac ? "AC" : "battery");
    if (!m_on_ac)
    {
-      os << ", current power consumption: " << m_battery.power_now() << " W (" << current_power() << " W)\n";
+      os << ", current power consumption: " << m_snapshot->power_now << " W (";
+
+      if (m_power.valid())
+      {
+         os << current_power() << " +/- " << m_power.error() << " W, r2 " << m_power.r2() << ")\n";
+      }
+      else
+      {
+         os << "estimating)\n";
+      }
+   }
+   else
+   {
+      os << "\n";
+   }
+
+   if (m_time_to_empty >= 0.0)
+   {
+      os << "Time to empty: " << format_minutes(m_time_to_empty) << "\n";
+   }
+   else if (m_time_to_full >= 0.0)
+   {
+      os << "Time to full: " << format_minutes(m_time_to_full) << "\n";
    }
    os << "\n";
+
+   sensor_schedule::clock::time_point minute_ago = sensor_schedule::clock::now() - std::chrono::minutes(1);
+   size_t wakeups = m_wakeups.end() - std::lower_bound(m_wakeups.begin(), m_wakeups.end(), minute_ago);
+
+   os << "Wakeups: " << wakeups << "/min, control interval: " << m_ticks.interval().count() << " ms\n";
+
+   latency_report(os);
+}
+
+void monitor_impl::latency_report(std::ostream& os) const
+{
+   typedef sysfs::io_stats::histogram histogram;
+
+   struct entry
+   {
+      const std::string *name;
+      const char *op;
+      const histogram *hist;
+      uint64_t p99;
+
+      bool operator<(const entry& rhs) const
+      {
+         return p99 > rhs.p99;
+      }
+   };
+
+   sysfs::io_stats::list_type stats;
+   sysfs::io_stats::list(stats);
+
+   std::vector<entry> entries;
+
+   for (sysfs::io_stats::list_type::const_iterator it = stats.begin(); it != stats.end(); ++it)
+   {
+      const histogram *hist[] = { &it->second->reads(), &it->second->writes() };
+      const char *op[] = { "read", "write" };
+
+      for (size_t i = 0; i < 2; ++i)
+      {
+         if (hist[i]->count() > 0)
+         {
+            entry e = { &it->first, op[i], hist[i], hist[i]->quantile(0.99) };
+            entries.push_back(e);
+         }
+      }
+   }
+
+   std::sort(entries.begin(), entries.end());
+
+   if (entries.size() > m_set.latency_report_size)
+   {
+      entries.resize(m_set.latency_report_size);
+   }
+
+   std::ios_base::fmtflags flags = os.flags();
+   std::streamsize precision = os.precision();
+
+   os << std::fixed << std::setprecision(1);
+
+   if (!entries.empty())
+   {
+      os << "Slowest sysfs accesses (p50/p99/max in us):\n";
+   }
+
+   for (std::vector<entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+   {
+      os << "  " << *it->name << " [" << it->op << "]: "
+         << it->hist->quantile(0.5)/1e3 << "/" << it->p99/1e3 << "/" << it->hist->max()/1e3
+         << " (" << it->hist->count() << " samples)\n";
+   }
+
+   for (sysfs::io_stats::list_type::const_iterator it = stats.begin(); it != stats.end(); ++it)
+   {
+      if (uint64_t n = it->second->over_budget())
+      {
+         os << "WARNING: " << it->first << " exceeded the " << m_set.latency_budget_ms
+            << " ms latency budget " << n << " times\n";
+      }
+   }
+
+   os.flags(flags);
+   os.precision(precision);
 }
 
 void monitor_impl::handle_event(event_code::type code)
 {
+   wake_periodic_check();
+
    if (code == event_code::LID_CLOSED)
    {
       LINFO(m_log, "lid closed");
@@ -28,6 +28,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef AIRD_MONITOR_H_
 #define AIRD_MONITOR_H_
 
+#include <chrono>
+#include <ostream>
+#include <string>
 #include <vector>
 
 #include <boost/asio.hpp>
@@ -37,6 +40,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 namespace aird {
 
 class root_logger;
+class fan_curve;
 class monitor_impl;
 class event_handler;
 class status_provider;
@@ -46,6 +50,9 @@ class monitor
 public:
    struct settings
    {
+      // given in seconds (fractions allowed) or with an "ms" or "s" suffix
+      typedef std::chrono::milliseconds duration;
+
       struct brightness
       {
          double exponent;
@@ -53,45 +60,91 @@ public:
          double delta_slow;
       };
 
+      enum fan_control
+      {
+         FAN_STEPPED,
+         FAN_CURVE,
+         FAN_PID
+      };
+
       struct power_mode
       {
          unsigned idle_timeout;
          unsigned display_backlight_idle_level;
          unsigned keyboard_backlight_idle_level;
 
-         unsigned fan_hot_delay;
-         unsigned fan_cold_delay;
+         duration fan_hot_delay;
+         duration fan_cold_delay;
          unsigned fan_speed_min;
          unsigned fan_speed_max;
          unsigned fan_speed_delta;
          double fan_temp_min;
          double fan_temp_delta;
-
-         unsigned cpu_hot_delay;
-         unsigned cpu_cold_delay;
+         fan_control fan_mode;
+         std::string fan_curve_spec;
+         boost::shared_ptr<const fan_curve> fan_table;
+         double fan_pid_setpoint;
+         double fan_pid_kp;
+         double fan_pid_ki;
+         double fan_pid_kd;
+         double fan_pid_slew;
+
+         duration cpu_hot_delay;
+         duration cpu_cold_delay;
          double cpu_temp_hot;
          double cpu_temp_cold;
-         unsigned cpu_throttle_delay;
-         unsigned cpu_unthrottle_delay;
+         duration cpu_throttle_delay;
+         duration cpu_unthrottle_delay;
          unsigned cpu_max_speed;
       };
 
       void add_options(boost::program_options::options_description& od);
 
+      // builds the fan curve lookup tables, call after parsing
+      void compile_fan_curves();
+      void dump_fan_curves(std::ostream& os) const;
+
       std::string hwmon_base_path;
+      std::string hwmon_class_path;
+      std::string device_cache;
+      std::string history_file;
+      std::string history_tiers;
+      std::string temp_filter;
+      std::string fan_filter;
       std::string intel_backlight_path;
       std::string battery_path;
       std::string ac_path;
       std::string cpu_base_path;
       brightness display_backlight;
       brightness keyboard_backlight;
-      unsigned check_interval;
-      unsigned power_interval;
+      duration check_interval;
+      duration max_check_interval;
+      double quiet_temp_slope;
+      double quiet_load;
+      double temp_jump;
+      duration timer_slack;
+      bool align_wakeups;
+      duration fan_interval;
+      duration battery_interval;
+      duration ac_interval;
+      duration light_interval;
+      duration cpufreq_interval;
+      duration power_interval;
       unsigned power_measurements;
+      duration actuator_verify_interval;
+      unsigned io_threads;
+      std::string sampler;
+      bool power_supply_events;
+      bool watch_attributes;
+      unsigned coretemp_scan_interval;
+      double coretemp_rescan_delta;
+      unsigned latency_budget_ms;
+      unsigned latency_report_size;
       power_mode on_ac;
       power_mode on_battery;
 
       double powersave_min_energy_percent;
+      double powersave_min_minutes;
       unsigned powersave_cpu_max_speed;
 
       unsigned min_safe_display_backlight;
@@ -0,0 +1,177 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include <boost/bind.hpp>
+
+#include "power_supply_watcher.h"
+
+namespace aird {
+
+power_supply_watcher::~power_supply_watcher()
+{
+}
+
+uevent_watcher::uevent_watcher(boost::asio::io_service& ios, root_logger& root, int fd)
+   : m_sock(ios, fd)
+   , m_log(root, "uevent_watcher")
+   , m_stopped(true)
+{
+}
+
+int uevent_watcher::open_netlink()
+{
+   int fd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+
+   if (fd < 0)
+   {
+      throw std::runtime_error("cannot create uevent socket: " + std::string(::strerror(errno)));
+   }
+
+   sockaddr_nl addr;
+   ::memset(&addr, 0, sizeof(addr));
+   addr.nl_family = AF_NETLINK;
+   addr.nl_groups = 1;  // kernel events
+
+   if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+   {
+      int err = errno;
+      ::close(fd);
+      throw std::runtime_error("cannot bind uevent socket: " + std::string(::strerror(err)));
+   }
+
+   return fd;
+}
+
+/*
+ * A uevent is "ACTION@DEVPATH" followed by NUL separated KEY=VALUE pairs.
+ */
+bool uevent_watcher::parse(const char *buf, size_t len, power_supply_event& ev)
+{
+   const char *end = buf + len;
+   const char *p = static_cast<const char *>(::memchr(buf, '\0', len));
+   bool power_supply = false;
+
+   ev.name.clear();
+   ev.online = -1;
+
+   if (!p || !::memchr(buf, '@', p - buf))
+   {
+      return false;
+   }
+
+   for (++p; p < end; p += ::strnlen(p, end - p) + 1)
+   {
+      size_t n = ::strnlen(p, end - p);
+
+      if (n == 22 && ::memcmp(p, "SUBSYSTEM=power_supply", 22) == 0)
+      {
+         power_supply = true;
+      }
+      else if (n > 18 && ::memcmp(p, "POWER_SUPPLY_NAME=", 18) == 0)
+      {
+         ev.name.assign(p + 18, n - 18);
+      }
+      else if (n == 21 && ::memcmp(p, "POWER_SUPPLY_ONLINE=", 20) == 0)
+      {
+         ev.online = p[20] == '1';
+      }
+   }
+
+   return power_supply && !ev.name.empty();
+}
+
+void uevent_watcher::start(const handler_type& handler)
+{
+   LINFO(m_log, "starting");
+   m_stopped = false;
+   m_handler = handler;
+   read_next_event();
+}
+
+void uevent_watcher::stop()
+{
+   if (!m_stopped)
+   {
+      m_stopped = true;
+      m_sock.close();
+   }
+}
+
+void uevent_watcher::read_next_event()
+{
+   m_sock.async_read_some(boost::asio::buffer(m_buffer, sizeof(m_buffer)),
+      boost::bind(&uevent_watcher::handle_read, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void uevent_watcher::handle_read(const boost::system::error_code& e, size_t bytes_read)
+{
+   if (e == boost::asio::error::no_buffer_space && !m_stopped)
+   {
+      LWARN(m_log, "uevent socket overrun, events were lost");
+
+      power_supply_event ev;
+      ev.online = -1;
+      m_handler(ev);
+
+      read_next_event();
+      return;
+   }
+
+   if (e)
+   {
+      if (m_stopped && e == boost::asio::error::operation_aborted)
+      {
+         LINFO(m_log, "stopped");
+      }
+      else
+      {
+         LERROR(m_log, "async read failed: " << e.message());
+      }
+
+      return;
+   }
+
+   power_supply_event ev;
+
+   if (parse(m_buffer, bytes_read, ev))
+   {
+      LDEBUG(m_log, "power_supply event: " << ev.name << " (online=" << ev.online << ")");
+      m_handler(ev);
+   }
+
+   read_next_event();
+}
+
+}
@@ -0,0 +1,89 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_POWER_SUPPLY_WATCHER_H_
+#define AIRD_POWER_SUPPLY_WATCHER_H_
+
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+
+#include "log.h"
+
+namespace aird {
+
+// an empty name means events were lost and the state must be re-read
+struct power_supply_event
+{
+   std::string name;
+   int online;  // -1 if not part of the event
+};
+
+class power_supply_watcher
+{
+public:
+   typedef boost::function<void (const power_supply_event&)> handler_type;
+
+   virtual ~power_supply_watcher();
+   virtual void start(const handler_type& handler) = 0;
+   virtual void stop() = 0;
+};
+
+/*
+ * Watches kernel uevents for power_supply changes. The descriptor is
+ * usually a NETLINK_KOBJECT_UEVENT socket from open_netlink(), but any
+ * datagram socket delivering messages in the same format will do, e.g.
+ * one end of a socketpair().
+ */
+class uevent_watcher : public power_supply_watcher
+                     , public boost::enable_shared_from_this<uevent_watcher>
+{
+public:
+   uevent_watcher(boost::asio::io_service& ios, root_logger& root, int fd);
+
+   static int open_netlink();
+   static bool parse(const char *buf, size_t len, power_supply_event& ev);
+
+   virtual void start(const handler_type& handler);
+   virtual void stop();
+
+private:
+   void read_next_event();
+   void handle_read(const boost::system::error_code& e, size_t bytes_read);
+
+   boost::asio::posix::stream_descriptor m_sock;
+   char m_buffer[8192];
+   handler_type m_handler;
+   logger m_log;
+   bool m_stopped;
+};
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include "rollup.h"
+
+namespace aird {
+
+namespace {
+
+rollup::duration parse_duration(const std::string& str)
+{
+   const char *beg = str.c_str();
+   char *end;
+   unsigned long value = ::strtoul(beg, &end, 10);
+   std::string unit(end);
+   long mult;
+
+   if (unit == "s")
+   {
+      mult = 1;
+   }
+   else if (unit == "m")
+   {
+      mult = 60;
+   }
+   else if (unit == "h")
+   {
+      mult = 3600;
+   }
+   else if (unit == "d")
+   {
+      mult = 86400;
+   }
+   else
+   {
+      mult = 0;
+   }
+
+   if (end == beg || value == 0 || mult == 0)
+   {
+      throw std::runtime_error("invalid rollup duration: " + str);
+   }
+
+   return std::chrono::seconds(value*mult);
+}
+
+}
+
+std::vector<rollup::tier> rollup::parse(const std::string& spec)
+{
+   std::istringstream is(spec);
+   std::vector<tier> tiers;
+   std::string item;
+
+   while (is >> item)
+   {
+      size_t colon = item.find(':');
+
+      if (colon == std::string::npos)
+      {
+         throw std::runtime_error("invalid rollup tier: " + item);
+      }
+
+      tier t;
+      t.resolution = parse_duration(item.substr(0, colon));
+      t.span = parse_duration(item.substr(colon + 1));
+
+      if (t.span < t.resolution)
+      {
+         throw std::runtime_error("rollup span shorter than resolution: " + item);
+      }
+
+      tiers.push_back(t);
+   }
+
+   return tiers;
+}
+
+rollup::rollup(const std::vector<tier>& tiers, size_t channels)
+   : m_channels(channels)
+   , m_input(channels)
+   , m_levels(tiers.size())
+{
+   for (size_t i = 0; i < tiers.size(); ++i)
+   {
+      level& l = m_levels[i];
+
+      l.spec = tiers[i];
+      l.series.reset(l.spec.span/l.spec.resolution, AGGREGATES*channels);
+      l.weight = 0.0;
+      l.acc.resize(AGGREGATES*channels);
+   }
+}
+
+void rollup::add(level& l, time_point t, double weight)
+{
+   time_point bucket(t.time_since_epoch() - t.time_since_epoch() % l.spec.resolution);
+
+   if (l.weight > 0.0 && bucket != l.bucket)
+   {
+      flush(l);
+   }
+
+   if (l.weight == 0.0)
+   {
+      l.bucket = bucket;
+
+      for (size_t c = 0; c < m_channels; ++c)
+      {
+         l.acc[channel(c, MIN)] = m_input[c];
+         l.acc[channel(c, MAX)] = m_input[c];
+         l.acc[channel(c, AVG)] = 0.0;
+      }
+   }
+
+   for (size_t c = 0; c < m_channels; ++c)
+   {
+      double v = m_input[c];
+
+      l.acc[channel(c, MIN)] = std::min(l.acc[channel(c, MIN)], v);
+      l.acc[channel(c, MAX)] = std::max(l.acc[channel(c, MAX)], v);
+      l.acc[channel(c, AVG)] += weight*v;
+   }
+
+   l.weight += weight;
+}
+
+void rollup::flush(level& l)
+{
+   for (size_t c = 0; c < m_channels; ++c)
+   {
+      l.acc[channel(c, AVG)] /= l.weight;
+   }
+
+   l.series.push(l.bucket, l.acc.begin());
+   l.weight = 0.0;
+}
+
+}
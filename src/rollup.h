@@ -0,0 +1,133 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_ROLLUP_H_
+#define AIRD_ROLLUP_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "time_series.h"
+
+namespace aird {
+
+/*
+ * Downsampled copies of a multi-channel time series in a fixed amount of
+ * memory, similar to an RRD. Each tier aggregates samples into buckets of
+ * its resolution and keeps the most recent buckets up to its span. For
+ * every input channel, a bucket stores min, max and the weighted average
+ * in channels 3*c, 3*c + 1 and 3*c + 2. A bucket is stored as soon as a
+ * sample for a later bucket arrives; buckets without samples (e.g. while
+ * suspended) are skipped.
+ */
+class rollup
+{
+public:
+   typedef time_series<double> series_type;
+   typedef series_type::clock::duration duration;
+   typedef series_type::time_point time_point;
+
+   enum aggregate
+   {
+      MIN,
+      MAX,
+      AVG,
+      AGGREGATES
+   };
+
+   struct tier
+   {
+      duration resolution;
+      duration span;
+   };
+
+   // parses a list like "1s:10m 10s:6h 5m:7d", units are s, m, h and d
+   static std::vector<tier> parse(const std::string& spec);
+
+   rollup(const std::vector<tier>& tiers, size_t channels);
+
+   template <typename InputIterator>
+   void add(time_point t, InputIterator values, double weight = 1.0)
+   {
+      for (size_t c = 0; c < m_channels; ++c, ++values)
+      {
+         m_input[c] = *values;
+      }
+
+      for (std::vector<level>::iterator it = m_levels.begin(); it != m_levels.end(); ++it)
+      {
+         add(*it, t, weight);
+      }
+   }
+
+   size_t tiers() const
+   {
+      return m_levels.size();
+   }
+
+   const tier& get_tier(size_t i) const
+   {
+      return m_levels[i].spec;
+   }
+
+   const series_type& series(size_t i) const
+   {
+      return m_levels[i].series;
+   }
+
+   size_t channels() const
+   {
+      return m_channels;
+   }
+
+   static size_t channel(size_t input, aggregate agg)
+   {
+      return AGGREGATES*input + agg;
+   }
+
+private:
+   struct level
+   {
+      tier spec;
+      series_type series;
+      time_point bucket;
+      double weight;
+      std::vector<double> acc;
+   };
+
+   void add(level& l, time_point t, double weight);
+   void flush(level& l);
+
+   const size_t m_channels;
+   std::vector<double> m_input;
+   std::vector<level> m_levels;
+};
+
+}
+
+#endif
@@ -0,0 +1,383 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "io_stats.h"
+#include "sampler.h"
+
+namespace aird {
+namespace sysfs {
+
+namespace {
+
+// most attributes are tiny, this only needs to fit the sampled ones
+const size_t SLOT_SIZE = 64;
+
+}
+
+class sampler_backend
+{
+public:
+   virtual ~sampler_backend()
+   {
+   }
+
+   virtual const char *name() const = 0;
+
+   // read size bytes from each fd at offset 0, store result (or -errno),
+   // return number of syscalls issued; backends that can time individual
+   // reads record them in stats
+   virtual size_t read(const int *fd, char *buf, size_t size, int *result, io_stats * const *stats, size_t count) = 0;
+};
+
+namespace {
+
+class pread_backend : public sampler_backend
+{
+public:
+   virtual const char *name() const
+   {
+      return "pread";
+   }
+
+   virtual size_t read(const int *fd, char *buf, size_t size, int *result, io_stats * const *stats, size_t count)
+   {
+      for (size_t i = 0; i < count; ++i)
+      {
+         io_stats::clock::time_point start = io_stats::clock::now();
+         ssize_t rv = ::pread(fd[i], buf + i*size, size, 0);
+         result[i] = rv < 0 ? -errno : int(rv);
+         stats[i]->record_read(io_stats::elapsed(start));
+      }
+
+      return count;
+   }
+};
+
+class uring_backend : public sampler_backend
+{
+public:
+   static const unsigned ENTRIES = 64;
+
+   uring_backend()
+      : m_fd(-1)
+      , m_sq_ring(MAP_FAILED)
+      , m_cq_ring(MAP_FAILED)
+      , m_sqes(MAP_FAILED)
+   {
+      io_uring_params p;
+      ::memset(&p, 0, sizeof(p));
+
+      m_fd = ::syscall(__NR_io_uring_setup, ENTRIES, &p);
+
+      if (m_fd < 0)
+      {
+         throw std::runtime_error(std::string("io_uring_setup: ") + ::strerror(errno));
+      }
+
+      // io_uring predates IORING_OP_READ (5.6), every batch would fail
+      if (!supports(IORING_OP_READ))
+      {
+         ::close(m_fd);
+         throw std::runtime_error("io_uring: IORING_OP_READ not supported");
+      }
+
+      m_sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+      m_cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+      m_sqes_size = p.sq_entries*sizeof(io_uring_sqe);
+
+      if (p.features & IORING_FEAT_SINGLE_MMAP)
+      {
+         m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+      }
+
+      m_sq_ring = map(m_sq_ring_size, IORING_OFF_SQ_RING);
+      m_cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP) ? m_sq_ring : map(m_cq_ring_size, IORING_OFF_CQ_RING);
+      m_sqes = map(m_sqes_size, IORING_OFF_SQES);
+
+      char *sq = static_cast<char *>(m_sq_ring);
+      char *cq = static_cast<char *>(m_cq_ring);
+
+      m_sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+      m_sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+      m_sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+      m_sq_entries = p.sq_entries;
+      m_cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+      m_cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+      m_cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+      m_cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+   }
+
+   ~uring_backend()
+   {
+      if (m_sqes != MAP_FAILED)
+      {
+         ::munmap(m_sqes, m_sqes_size);
+      }
+
+      if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+      {
+         ::munmap(m_cq_ring, m_cq_ring_size);
+      }
+
+      if (m_sq_ring != MAP_FAILED)
+      {
+         ::munmap(m_sq_ring, m_sq_ring_size);
+      }
+
+      if (m_fd >= 0)
+      {
+         ::close(m_fd);
+      }
+   }
+
+   virtual const char *name() const
+   {
+      return "io_uring";
+   }
+
+   virtual size_t read(const int *fd, char *buf, size_t size, int *result, io_stats * const *, size_t count)
+   {
+      size_t calls = 0;
+
+      for (size_t beg = 0; beg < count; beg += m_sq_entries)
+      {
+         unsigned batch = std::min<size_t>(count - beg, m_sq_entries);
+         unsigned tail = *m_sq_tail;
+         io_uring_sqe *sqes = static_cast<io_uring_sqe *>(m_sqes);
+
+         for (unsigned i = 0; i < batch; ++i, ++tail)
+         {
+            unsigned ix = tail & m_sq_mask;
+            io_uring_sqe& sqe = sqes[ix];
+            size_t n = beg + i;
+
+            ::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fd[n];
+            sqe.addr = reinterpret_cast<uintptr_t>(buf + n*size);
+            sqe.len = size;
+            sqe.off = 0;
+            sqe.user_data = n;
+
+            m_sq_array[ix] = ix;
+         }
+
+         __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+         for (unsigned submitted = 0, done = 0; done < batch; )
+         {
+            int rv = ::syscall(__NR_io_uring_enter, m_fd, batch - submitted, batch - done, IORING_ENTER_GETEVENTS, NULL, 0);
+            ++calls;
+
+            if (rv < 0)
+            {
+               if (errno == EINTR)
+               {
+                  continue;
+               }
+
+               throw std::runtime_error(std::string("io_uring_enter: ") + ::strerror(errno));
+            }
+
+            submitted += rv;
+
+            unsigned head = *m_cq_head;
+
+            while (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+            {
+               const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+               result[cqe.user_data] = cqe.res;
+               ++head;
+               ++done;
+            }
+
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+         }
+      }
+
+      return calls;
+   }
+
+private:
+   // kernels without IORING_REGISTER_PROBE (before 5.6) fail with EINVAL
+   bool supports(unsigned opcode) const
+   {
+      const unsigned max_ops = 256;
+      std::vector<char> buf(sizeof(io_uring_probe) + max_ops*sizeof(io_uring_probe_op));
+      io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+
+      if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, max_ops) < 0)
+      {
+         return false;
+      }
+
+      return opcode <= probe->last_op && opcode < probe->ops_len && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+   }
+
+   void *map(size_t size, off_t offset)
+   {
+      void *p = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+
+      if (p == MAP_FAILED)
+      {
+         throw std::runtime_error(std::string("io_uring mmap: ") + ::strerror(errno));
+      }
+
+      return p;
+   }
+
+   int m_fd;
+   void *m_sq_ring;
+   void *m_cq_ring;
+   void *m_sqes;
+   size_t m_sq_ring_size;
+   size_t m_cq_ring_size;
+   size_t m_sqes_size;
+   unsigned *m_sq_tail;
+   unsigned m_sq_mask;
+   unsigned *m_sq_array;
+   unsigned m_sq_entries;
+   unsigned *m_cq_head;
+   unsigned *m_cq_tail;
+   unsigned m_cq_mask;
+   io_uring_cqe *m_cqes;
+};
+
+}
+
+sampler::sampler(const std::string& backend)
+   : m_syscalls(0)
+{
+   if (backend == "io_uring")
+   {
+      try
+      {
+         m_backend.reset(new uring_backend);
+      }
+      catch (const std::runtime_error&)
+      {
+         // not supported by this kernel or not permitted, use pread
+      }
+   }
+   else if (backend != "pread")
+   {
+      throw std::runtime_error("invalid sampler backend: " + backend);
+   }
+
+   if (!m_backend)
+   {
+      m_backend.reset(new pread_backend);
+   }
+
+   m_stats = io_stats::get(std::string("[") + m_backend->name() + " batch]");
+}
+
+sampler::~sampler()
+{
+}
+
+void sampler::add(const attribute& attr, unsigned group)
+{
+   m_attr.push_back(&attr);
+   m_attr_stats.push_back(io_stats::get(attr.path().native()));
+   m_group.push_back(uint32_t(1) << group);
+   m_buffer.resize(m_attr.size()*SLOT_SIZE);
+   m_fd.resize(m_attr.size());
+   m_result.resize(m_attr.size());
+}
+
+void sampler::sample(uint32_t groups)
+{
+   m_due.clear();
+   m_due_stats.clear();
+
+   for (size_t i = 0; i < m_attr.size(); ++i)
+   {
+      if (m_group[i] & groups)
+      {
+         m_due.push_back(m_attr[i]);
+         m_due_stats.push_back(m_attr_stats[i].get());
+      }
+   }
+
+   if (m_due.empty())
+   {
+      m_syscalls = 0;
+      return;
+   }
+
+   for (size_t i = 0; i < m_due.size(); ++i)
+   {
+      try
+      {
+         m_fd[i] = m_due[i]->fd();
+      }
+      catch (const std::runtime_error&)
+      {
+         // the regular read will report this
+         m_fd[i] = -1;
+      }
+   }
+
+   io_stats::clock::time_point start = io_stats::clock::now();
+
+   m_syscalls = m_backend->read(m_fd.data(), m_buffer.data(), SLOT_SIZE, m_result.data(), m_due_stats.data(), m_due.size());
+
+   m_stats->record_read(io_stats::elapsed(start));
+
+   for (size_t i = 0; i < m_due.size(); ++i)
+   {
+      if (m_result[i] >= 0)
+      {
+         m_due[i]->prefetched(m_buffer.data() + i*SLOT_SIZE, m_result[i]);
+      }
+      else
+      {
+         m_due[i]->prefetched(0, 0);
+      }
+   }
+}
+
+const char *sampler::backend() const
+{
+   return m_backend->name();
+}
+
+}
+}
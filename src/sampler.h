@@ -0,0 +1,99 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_SAMPLER_H_
+#define AIRD_SAMPLER_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include "sysfs.h"
+
+namespace aird {
+namespace sysfs {
+
+class sampler_backend;
+class io_stats;
+
+/*
+ * Reads a fixed set of attributes in one go at the start of a tick. The
+ * values are handed to the attributes as prefetched data, so the regular
+ * read path picks them up without touching the file again. Attributes
+ * that could not be read in the batch simply fall back to a normal read.
+ *
+ * The "io_uring" backend submits all reads with a single io_uring_enter()
+ * call; the "pread" backend issues one pread() per attribute. If io_uring
+ * is not available, the sampler falls back to pread. The latency of the
+ * whole batch is recorded in io_stats under "[<backend> batch]"; the pread
+ * backend also records each read under the attribute's own path.
+ *
+ * Attributes can be tagged with a group (0..31), so a tick only reads
+ * the groups that are due.
+ */
+class sampler
+{
+public:
+   sampler(const std::string& backend);
+   ~sampler();
+
+   void add(const attribute& attr, unsigned group = 0);
+   void sample(uint32_t groups = ~uint32_t(0));
+
+   const char *backend() const;
+   size_t size() const
+   {
+      return m_attr.size();
+   }
+
+   // number of syscalls issued by the last call to sample()
+   size_t syscalls() const
+   {
+      return m_syscalls;
+   }
+
+private:
+   std::vector<const attribute *> m_attr;
+   std::vector<boost::shared_ptr<io_stats> > m_attr_stats;
+   std::vector<uint32_t> m_group;
+   std::vector<const attribute *> m_due;
+   std::vector<io_stats *> m_due_stats;
+   std::vector<char> m_buffer;
+   std::vector<int> m_fd;
+   std::vector<int> m_result;
+   boost::shared_ptr<sampler_backend> m_backend;
+   boost::shared_ptr<io_stats> m_stats;
+   size_t m_syscalls;
+};
+
+}
+}
+
+#endif
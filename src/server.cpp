@@ -40,6 +40,8 @@ class connection : public boost::enable_shared_from_this<connection>
 public:
    connection(boost::asio::io_service& ios, root_logger& root)
       : m_socket(ios)
+      , m_request(MAX_REQUEST_SIZE)
+      , m_timer(ios)
       , m_log(root, "connection")
    {
    }
@@ -63,12 +65,87 @@ public:
          os << "error while getting status: " << e.what() << '\n';
       }
 
+      write();
+   }
+
+   // reads a single request line before answering
+   void start_query(boost::shared_ptr<status_provider> provider)
+   {
+      m_timer.expires_from_now(boost::posix_time::seconds(REQUEST_TIMEOUT));
+      m_timer.async_wait(boost::bind(&connection::handle_timeout, shared_from_this(), boost::asio::placeholders::error));
+
+      boost::asio::async_read_until(m_socket, m_request, '\n',
+          boost::bind(&connection::handle_read, shared_from_this(), provider,
+            boost::asio::placeholders::error));
+   }
+
+private:
+   static const size_t MAX_REQUEST_SIZE = 1024;
+   static const long REQUEST_TIMEOUT = 5;
+
+   void handle_timeout(const boost::system::error_code& error)
+   {
+      if (error != boost::asio::error::operation_aborted)
+      {
+         LWARN(m_log, "timeout waiting for request");
+         m_socket.close();
+      }
+   }
+
+   void write()
+   {
       boost::asio::async_write(m_socket, m_buffer,
           boost::bind(&connection::handle_write, shared_from_this(),
             boost::asio::placeholders::error));
    }
 
-private:
+   void handle_read(boost::shared_ptr<status_provider> provider, const boost::system::error_code& error)
+   {
+      m_timer.cancel();
+
+      if (error == boost::asio::error::not_found)
+      {
+         std::ostream os(&m_buffer);
+         os << "error: request too long\n";
+         write();
+         return;
+      }
+
+      if (error == boost::asio::error::operation_aborted)
+      {
+         return;
+      }
+
+      if (error && error != boost::asio::error::eof)
+      {
+         LERROR(m_log, "error during read: " << error.message());
+         m_socket.close();
+         return;
+      }
+
+      std::istream is(&m_request);
+      std::ostream os(&m_buffer);
+      std::string request;
+
+      std::getline(is, request);
+
+      if (!request.empty() && request[request.size() - 1] == '\r')
+      {
+         request.erase(request.size() - 1);
+      }
+
+      try
+      {
+         provider->query(request, os);
+      }
+      catch (const std::exception& e)
+      {
+         os << "error: " << e.what() << '\n';
+      }
+
+      write();
+   }
+
    void handle_write(const boost::system::error_code& error)
    {
       if (error)
@@ -80,7 +157,9 @@ private:
    }
 
    boost::asio::ip::tcp::socket m_socket;
+   boost::asio::streambuf m_request;
    boost::asio::streambuf m_buffer;
+   boost::asio::deadline_timer m_timer;
    logger m_log;
 };
 
@@ -96,10 +175,14 @@ public:
 private:
    void start_accept();
    void handle_accept(boost::shared_ptr<connection> new_conn, const boost::system::error_code& error);
+   void start_query_accept();
+   void handle_query_accept(boost::shared_ptr<connection> new_conn, const boost::system::error_code& error);
 
    boost::asio::io_service& m_ios;
    boost::asio::ip::tcp::acceptor m_acceptor;
    boost::asio::deadline_timer m_accept_timer;
+   boost::shared_ptr<boost::asio::ip::tcp::acceptor> m_query_acceptor;
+   boost::asio::deadline_timer m_query_accept_timer;
    boost::shared_ptr<status_provider> m_provider;
    bool m_stopped;
    logger m_log;
@@ -113,10 +196,18 @@ server_impl::server_impl(boost::asio::io_service& ios, root_logger& root, const
    : m_ios(ios)
    , m_acceptor(ios, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), set.port))
    , m_accept_timer(ios)
+   , m_query_accept_timer(ios)
    , m_stopped(true)
    , m_log(root, "server")
 {
    m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+
+   if (set.query_port != 0)
+   {
+      // sensor history is nobody else's business
+      m_query_acceptor.reset(new boost::asio::ip::tcp::acceptor(ios, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), set.query_port)));
+      m_query_acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+   }
 }
 
 void server_impl::start(boost::shared_ptr<status_provider> provider)
@@ -124,6 +215,7 @@ void server_impl::start(boost::shared_ptr<status_provider> provider)
    m_stopped = false;
    m_provider = provider;
    start_accept();
+   start_query_accept();
 }
 
 void server_impl::stop()
@@ -133,6 +225,12 @@ void server_impl::stop()
       m_stopped = true;
       m_accept_timer.cancel();
       m_acceptor.close();
+
+      if (m_query_acceptor)
+      {
+         m_query_accept_timer.cancel();
+         m_query_acceptor->close();
+      }
    }
 }
 
@@ -169,12 +267,42 @@ void server_impl::handle_accept(boost::shared_ptr<connection> new_conn, const bo
    }
 }
 
+void server_impl::start_query_accept()
+{
+   if (!m_stopped && m_query_acceptor)
+   {
+      boost::shared_ptr<connection> new_conn(new connection(m_ios, m_log.root()));
+      m_query_acceptor->async_accept(new_conn->socket(),
+          boost::bind(&server_impl::handle_query_accept, this, new_conn,
+            boost::asio::placeholders::error));
+   }
+}
+
+void server_impl::handle_query_accept(boost::shared_ptr<connection> new_conn, const boost::system::error_code& e)
+{
+   if (e)
+   {
+      if (!(m_stopped && e == boost::asio::error::operation_aborted))
+      {
+         LERROR(m_log, "query accept failed: " << e.message());
+         m_query_accept_timer.expires_from_now(boost::posix_time::milliseconds(1000));
+         m_query_accept_timer.async_wait(boost::bind(&server_impl::start_query_accept, this));
+      }
+   }
+   else
+   {
+      new_conn->start_query(m_provider);
+      start_query_accept();
+   }
+}
+
 void server::settings::add_options(boost::program_options::options_description& od)
 {
    using namespace boost::program_options;
 
    od.add_options()
       ("server.port", value<uint16_t>(&port)->default_value(21577))
+      ("server.query_port", value<uint16_t>(&query_port)->default_value(0))
       ;
 }
 
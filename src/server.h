@@ -29,6 +29,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define AIRD_SERVER_H_
 
 #include <ostream>
+#include <string>
 
 #include <boost/asio.hpp>
 #include <boost/program_options.hpp>
@@ -44,6 +45,7 @@ class status_provider
 public:
    virtual ~status_provider();
    virtual void status(std::ostream& os) const = 0;
+   virtual void query(const std::string& request, std::ostream& os) const = 0;
 };
 
 class server
@@ -54,6 +56,7 @@ public:
       void add_options(boost::program_options::options_description& od);
 
       uint16_t port;
+      uint16_t query_port;
    };
 
    server(boost::asio::io_service& ios, root_logger& root, const settings& set);
@@ -61,6 +61,7 @@ settings::settings(const std::string& config_file)
       variables_map vm;
       store(parse_config_file(ifs, options), vm);
       notify(vm);
+      mon.compile_fan_curves();
       root_level = log_level::str2level(root);
       console_level = log_level::str2level(console);
       syslog_level = log_level::str2level(syslog);
@@ -0,0 +1,123 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_SLIDING_WINDOW_H_
+#define AIRD_SLIDING_WINDOW_H_
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <utility>
+
+namespace aird {
+
+/*
+ * Running extremum over the last window() samples, using a monotonic
+ * deque: a new sample drops every older sample it beats, as those can
+ * never become the extremum again. Each sample is pushed and popped at
+ * most once, so push() is amortized O(1). With Compare = std::less the
+ * extremum is the minimum, with std::greater the maximum.
+ */
+template <typename T, typename Compare = std::less<T> >
+class sliding_extremum
+{
+public:
+   explicit sliding_extremum(size_t window = 1, const Compare& comp = Compare())
+      : m_window(window > 0 ? window : 1)
+      , m_count(0)
+      , m_comp(comp)
+   {
+   }
+
+   void push(const T& value)
+   {
+      while (!m_deque.empty() && !m_comp(m_deque.back().second, value))
+      {
+         m_deque.pop_back();
+      }
+
+      m_deque.push_back(std::make_pair(m_count++, value));
+
+      if (m_deque.front().first + m_window <= m_count - 1)
+      {
+         m_deque.pop_front();
+      }
+   }
+
+   // only valid if at least one sample has been pushed
+   const T& value() const
+   {
+      return m_deque.front().second;
+   }
+
+   bool empty() const
+   {
+      return m_deque.empty();
+   }
+
+   size_t window() const
+   {
+      return m_window;
+   }
+
+   // drops all samples
+   void reset(size_t window)
+   {
+      m_window = window > 0 ? window : 1;
+      m_deque.clear();
+   }
+
+private:
+   std::deque<std::pair<size_t, T> > m_deque;
+   size_t m_window;
+   size_t m_count;
+   Compare m_comp;
+};
+
+template <typename T>
+class sliding_min : public sliding_extremum<T, std::less<T> >
+{
+public:
+   explicit sliding_min(size_t window = 1)
+      : sliding_extremum<T, std::less<T> >(window)
+   {
+   }
+};
+
+template <typename T>
+class sliding_max : public sliding_extremum<T, std::greater<T> >
+{
+public:
+   explicit sliding_max(size_t window = 1)
+      : sliding_extremum<T, std::greater<T> >(window)
+   {
+   }
+};
+
+}
+
+#endif
@@ -0,0 +1,349 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <boost/weak_ptr.hpp>
+
+#include "io_stats.h"
+#include "sysfs.h"
+
+namespace aird {
+namespace sysfs {
+
+namespace {
+
+bool is_stale(int err)
+{
+   return err == ENODEV || err == ESTALE;
+}
+
+}
+
+boost::shared_ptr<directory> directory::get(const boost::filesystem::path& path)
+{
+   static std::mutex mutex;
+   static std::map<std::string, boost::weak_ptr<directory> > registry;
+
+   std::lock_guard<std::mutex> lock(mutex);
+   boost::weak_ptr<directory>& weak = registry[path.native()];
+   boost::shared_ptr<directory> dir = weak.lock();
+
+   if (!dir)
+   {
+      dir.reset(new directory(path));
+      weak = dir;
+   }
+
+   return dir;
+}
+
+directory::directory(const boost::filesystem::path& path)
+   : m_path(path)
+   , m_fd(-1)
+{
+}
+
+directory::~directory()
+{
+   close_dir();
+}
+
+uint32_t directory::add(const char *name)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   for (size_t i = 0; i < m_offset.size(); ++i)
+   {
+      if (::strcmp(&m_names[m_offset[i]], name) == 0)
+      {
+         return i;
+      }
+   }
+
+   m_offset.push_back(m_names.size());
+   m_names.insert(m_names.end(), name, name + ::strlen(name) + 1);
+
+   return m_offset.size() - 1;
+}
+
+int directory::open(uint32_t handle, int flags) const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   for (bool retry = m_fd >= 0; ; retry = false)
+   {
+      if (!open_dir())
+      {
+         return -1;
+      }
+
+      int fd = ::openat(m_fd, &m_names[m_offset[handle]], flags | O_CLOEXEC);
+
+      // the directory itself may have been replaced
+      if (fd >= 0 || !retry || !(is_stale(errno) || errno == ENOENT))
+      {
+         return fd;
+      }
+
+      close_dir();
+   }
+}
+
+bool directory::exists(uint32_t handle) const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   return open_dir() && ::faccessat(m_fd, &m_names[m_offset[handle]], F_OK, 0) == 0;
+}
+
+boost::filesystem::path directory::path(uint32_t handle) const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   return m_path / &m_names[m_offset[handle]];
+}
+
+bool directory::open_dir() const
+{
+   if (m_fd < 0)
+   {
+      m_fd = ::open(m_path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+   }
+
+   return m_fd >= 0;
+}
+
+void directory::close_dir() const
+{
+   if (m_fd >= 0)
+   {
+      ::close(m_fd);
+      m_fd = -1;
+   }
+}
+
+attribute::attribute(const boost::shared_ptr<directory>& dir, const char *name)
+   : m_dir(dir)
+   , m_handle(dir->add(name))
+   , m_rdfd(-1)
+   , m_wrfd(-1)
+   , m_prefetch(0)
+   , m_prefetch_size(0)
+{
+   init();
+}
+
+attribute::attribute(const boost::filesystem::path& path)
+   : m_dir(directory::get(path.parent_path()))
+   , m_handle(m_dir->add(path.filename().c_str()))
+   , m_rdfd(-1)
+   , m_wrfd(-1)
+   , m_prefetch(0)
+   , m_prefetch_size(0)
+{
+   init();
+}
+
+attribute::attribute(const attribute& other)
+   : m_dir(other.m_dir)
+   , m_stats(other.m_stats)
+   , m_handle(other.m_handle)
+   , m_rdfd(-1)
+   , m_wrfd(-1)
+   , m_prefetch(0)
+   , m_prefetch_size(0)
+{
+}
+
+attribute& attribute::operator=(const attribute& other)
+{
+   if (this != &other)
+   {
+      close();
+      m_dir = other.m_dir;
+      m_stats = other.m_stats;
+      m_handle = other.m_handle;
+      m_prefetch = 0;
+   }
+
+   return *this;
+}
+
+attribute::~attribute()
+{
+   close();
+}
+
+size_t attribute::read(char *buf, size_t size) const
+{
+   if (m_prefetch)
+   {
+      size = std::min(size, m_prefetch_size);
+      std::copy(m_prefetch, m_prefetch + size, buf);
+      m_prefetch = 0;
+      return size;
+   }
+
+   io_stats::clock::time_point start = io_stats::clock::now();
+
+   for (bool retry = true; ; retry = false)
+   {
+      if (m_rdfd < 0)
+      {
+         m_rdfd = open(O_RDONLY);
+      }
+
+      ssize_t rv;
+
+      do
+      {
+         rv = ::pread(m_rdfd, buf, size, 0);
+      }
+      while (rv < 0 && errno == EINTR);
+
+      if (rv >= 0)
+      {
+         m_stats->record_read(io_stats::elapsed(start));
+         return rv;
+      }
+
+      int err = errno;
+
+      if (!retry || !is_stale(err))
+      {
+         error("cannot read file", err);
+      }
+
+      close();
+   }
+}
+
+void attribute::write(const char *buf, size_t size) const
+{
+   io_stats::clock::time_point start = io_stats::clock::now();
+
+   for (bool retry = true; ; retry = false)
+   {
+      if (m_wrfd < 0)
+      {
+         m_wrfd = open(O_WRONLY);
+      }
+
+      ssize_t rv;
+
+      do
+      {
+         rv = ::pwrite(m_wrfd, buf, size, 0);
+      }
+      while (rv < 0 && errno == EINTR);
+
+      if (rv >= 0)
+      {
+         m_stats->record_write(io_stats::elapsed(start));
+         return;
+      }
+
+      int err = errno;
+
+      if (!retry || !is_stale(err))
+      {
+         error("cannot write file", err);
+      }
+
+      close();
+   }
+}
+
+int attribute::fd() const
+{
+   if (m_rdfd < 0)
+   {
+      m_rdfd = open(O_RDONLY);
+   }
+
+   return m_rdfd;
+}
+
+void attribute::prefetched(const char *data, size_t size) const
+{
+   m_prefetch = data;
+   m_prefetch_size = size;
+}
+
+bool attribute::exists() const
+{
+   return m_rdfd >= 0 || m_wrfd >= 0 || m_dir->exists(m_handle);
+}
+
+void attribute::init()
+{
+   // statistics are never released, so a plain pointer will do
+   m_stats = io_stats::get(path().native()).get();
+}
+
+int attribute::open(int flags) const
+{
+   int fd = m_dir->open(m_handle, flags);
+
+   if (fd < 0)
+   {
+      error("cannot open file", errno);
+   }
+
+   return fd;
+}
+
+void attribute::close() const
+{
+   if (m_rdfd >= 0)
+   {
+      ::close(m_rdfd);
+      m_rdfd = -1;
+   }
+
+   if (m_wrfd >= 0)
+   {
+      ::close(m_wrfd);
+      m_wrfd = -1;
+   }
+}
+
+void attribute::error(const char *what, int err) const
+{
+   throw std::runtime_error(std::string(what) + ": " + path().native() + " (" + ::strerror(err) + ")");
+}
+
+}
+}
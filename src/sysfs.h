@@ -0,0 +1,149 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_SYSFS_H_
+#define AIRD_SYSFS_H_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace aird {
+namespace sysfs {
+
+class io_stats;
+
+/*
+ * A sysfs directory, usually a device. The directory is opened once as
+ * an O_PATH descriptor and the attributes below it are opened relative
+ * to it with openat(), so the full path never has to be walked again.
+ * Attribute names are stored back to back in a single table and are
+ * referred to by a small integer handle.
+ *
+ * Directories are shared: get() returns the same instance for the same
+ * path as long as it is referenced.
+ */
+class directory
+{
+public:
+   static boost::shared_ptr<directory> get(const boost::filesystem::path& path);
+
+   ~directory();
+
+   // register a (relative) attribute name, returns its handle
+   uint32_t add(const char *name);
+
+   // open an attribute, returns -1 and sets errno on failure
+   int open(uint32_t handle, int flags) const;
+   bool exists(uint32_t handle) const;
+
+   boost::filesystem::path path(uint32_t handle) const;
+
+   const boost::filesystem::path& path() const
+   {
+      return m_path;
+   }
+
+private:
+   explicit directory(const boost::filesystem::path& path);
+   directory(const directory&);
+   directory& operator=(const directory&);
+
+   bool open_dir() const;
+   void close_dir() const;
+
+   const boost::filesystem::path m_path;
+   std::vector<char> m_names;
+   std::vector<uint32_t> m_offset;
+   mutable int m_fd;
+   mutable std::mutex m_mutex;
+};
+
+/*
+ * A single sysfs attribute. The file is opened on first access and kept
+ * open; subsequent reads re-read the value with pread() at offset 0, so
+ * each read costs exactly one syscall. If the underlying kobject went
+ * away and came back (ENODEV/ESTALE), the file is reopened once.
+ * The latency of each read and write is recorded in io_stats.
+ */
+class attribute
+{
+public:
+   // sysfs attributes never exceed a single page
+   static const size_t MAX_SIZE = 4096;
+
+   attribute(const boost::shared_ptr<directory>& dir, const char *name);
+   explicit attribute(const boost::filesystem::path& path);
+   attribute(const attribute& other);
+   attribute& operator=(const attribute& other);
+   ~attribute();
+
+   size_t read(char *buf, size_t size) const;
+   void write(const char *buf, size_t size) const;
+
+   // file descriptor used for reading, opened on demand
+   int fd() const;
+
+   // hand a value read elsewhere (e.g. in a batch) to the next read()
+   void prefetched(const char *data, size_t size) const;
+
+   bool exists() const;
+
+   const io_stats& stats() const
+   {
+      return *m_stats;
+   }
+
+   boost::filesystem::path path() const
+   {
+      return m_dir->path(m_handle);
+   }
+
+private:
+   void init();
+   int open(int flags) const;
+   void close() const;
+   void error(const char *what, int err) const;
+
+   boost::shared_ptr<directory> m_dir;
+   io_stats *m_stats;
+   uint32_t m_handle;
+   mutable int m_rdfd;
+   mutable int m_wrfd;
+   mutable const char *m_prefetch;
+   mutable size_t m_prefetch_size;
+};
+
+}
+}
+
+#endif
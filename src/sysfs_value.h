@@ -0,0 +1,323 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_SYSFS_VALUE_H_
+#define AIRD_SYSFS_VALUE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace aird {
+namespace sysfs {
+
+/*
+ * Parsing and formatting of sysfs attribute values. All of this works
+ * directly on a (stack) character buffer and does not allocate, except
+ * for std::string values and when reporting errors. The implementation
+ * is picked at compile time through value_traits<T>.
+ */
+
+namespace detail {
+
+inline bool is_space(char c)
+{
+   return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline const char *skip_space(const char *p, const char *end)
+{
+   while (p != end && is_space(*p))
+   {
+      ++p;
+   }
+
+   return p;
+}
+
+inline void invalid_value(const char *beg, const char *end)
+{
+   throw std::runtime_error("invalid attribute value: '" + std::string(beg, end) + "'");
+}
+
+template <typename T>
+const char *parse_integer(const char *p, const char *end, T& value)
+{
+   typedef typename std::make_unsigned<T>::type U;
+
+   bool neg = false;
+
+   if (p != end && (*p == '-' || *p == '+'))
+   {
+      neg = *p++ == '-';
+
+      if (neg && !std::is_signed<T>::value)
+      {
+         return 0;
+      }
+   }
+
+   const char *digits = p;
+   U limit = neg ? U(std::numeric_limits<T>::max()) + 1 : U(std::numeric_limits<T>::max());
+   U acc = 0;
+
+   while (p != end && *p >= '0' && *p <= '9')
+   {
+      U d = *p++ - '0';
+
+      if (acc > (limit - d)/10)
+      {
+         return 0;
+      }
+
+      acc = 10*acc + d;
+   }
+
+   if (p == digits)
+   {
+      return 0;
+   }
+
+   value = neg ? T(U(0) - acc) : T(acc);
+
+   return p;
+}
+
+template <typename T>
+size_t format_integer(T value, char *buf, size_t size)
+{
+   typedef typename std::make_unsigned<T>::type U;
+
+   char tmp[std::numeric_limits<U>::digits10 + 2];
+   char *p = tmp + sizeof(tmp);
+   bool neg = value < 0;
+   U acc = neg ? U(0) - U(value) : U(value);
+
+   do
+   {
+      *--p = '0' + acc % 10;
+      acc /= 10;
+   }
+   while (acc);
+
+   if (neg)
+   {
+      *--p = '-';
+   }
+
+   size_t len = tmp + sizeof(tmp) - p;
+
+   if (len > size)
+   {
+      throw std::length_error("buffer too small for attribute value");
+   }
+
+   std::copy(p, tmp + sizeof(tmp), buf);
+
+   return len;
+}
+
+}
+
+template <typename T, typename Enable = void>
+struct value_traits;
+
+// Plain integers: millidegrees, rpm, kHz, microvolts, µAh, brightness, ...
+template <typename T>
+struct value_traits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+{
+   static T parse(const char *beg, const char *end)
+   {
+      T value;
+      const char *p = detail::parse_integer(detail::skip_space(beg, end), end, value);
+
+      if (!p || detail::skip_space(p, end) != end)
+      {
+         detail::invalid_value(beg, end);
+      }
+
+      return value;
+   }
+
+   static size_t format(T value, char *buf, size_t size)
+   {
+      return detail::format_integer(value, buf, size);
+   }
+};
+
+// Fractional values; sysfs virtually never has these, so the parser only
+// handles plain decimal notation.
+template <typename T>
+struct value_traits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+   static T parse(const char *beg, const char *end)
+   {
+      const char *p = detail::skip_space(beg, end);
+      bool neg = false;
+
+      if (p != end && (*p == '-' || *p == '+'))
+      {
+         neg = *p++ == '-';
+      }
+
+      const char *digits = p;
+      T value = 0;
+
+      while (p != end && *p >= '0' && *p <= '9')
+      {
+         value = 10*value + (*p++ - '0');
+      }
+
+      if (p != end && *p == '.')
+      {
+         T scale = 1;
+
+         for (++p; p != end && *p >= '0' && *p <= '9'; ++p)
+         {
+            scale /= 10;
+            value += scale*(*p - '0');
+         }
+      }
+
+      if (p == digits || detail::skip_space(p, end) != end)
+      {
+         detail::invalid_value(beg, end);
+      }
+
+      return neg ? -value : value;
+   }
+
+   static size_t format(T value, char *buf, size_t size)
+   {
+      int len = ::snprintf(buf, size, "%.*g", std::numeric_limits<T>::digits10, double(value));
+
+      if (len < 0 || size_t(len) >= size)
+      {
+         throw std::length_error("buffer too small for attribute value");
+      }
+
+      return len;
+   }
+};
+
+// Flags such as fanN_manual or online: "0"/"1", also accepts "N"/"Y"
+template <>
+struct value_traits<bool>
+{
+   static bool parse(const char *beg, const char *end)
+   {
+      const char *p = detail::skip_space(beg, end);
+
+      if (p != end && detail::skip_space(p + 1, end) == end)
+      {
+         switch (*p)
+         {
+            case '0': case 'N': case 'n': return false;
+            case '1': case 'Y': case 'y': return true;
+         }
+      }
+
+      detail::invalid_value(beg, end);
+
+      return false;
+   }
+
+   static size_t format(bool value, char *buf, size_t size)
+   {
+      if (size < 1)
+      {
+         throw std::length_error("buffer too small for attribute value");
+      }
+
+      *buf = value ? '1' : '0';
+
+      return 1;
+   }
+};
+
+// Tuples of the form "(l,r)", e.g. the applesmc light sensor
+template <typename T>
+struct value_traits< std::pair<T, T> >
+{
+   static std::pair<T, T> parse(const char *beg, const char *end)
+   {
+      std::pair<T, T> value;
+      const char *p = detail::skip_space(beg, end);
+
+      if (p != end && *p++ == '(' &&
+          (p = detail::parse_integer(p, end, value.first)) && p != end && *p++ == ',' &&
+          (p = detail::parse_integer(p, end, value.second)) && p != end && *p++ == ')' &&
+          detail::skip_space(p, end) == end)
+      {
+         return value;
+      }
+
+      detail::invalid_value(beg, end);
+
+      return value;
+   }
+};
+
+template <>
+struct value_traits<std::string>
+{
+   static std::string parse(const char *beg, const char *end)
+   {
+      return std::string(beg, end);
+   }
+};
+
+// Whitespace separated lists, e.g. scaling_available_frequencies
+template <typename T, typename OutputIterator>
+void parse_list(const char *beg, const char *end, OutputIterator out)
+{
+   const char *p = detail::skip_space(beg, end);
+
+   while (p != end)
+   {
+      const char *q = p;
+
+      while (q != end && !detail::is_space(*q))
+      {
+         ++q;
+      }
+
+      *out++ = value_traits<T>::parse(p, q);
+
+      p = detail::skip_space(q, end);
+   }
+}
+
+}
+}
+
+#endif
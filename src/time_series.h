@@ -0,0 +1,210 @@
+/* vim:set ts=3 sw=3 sts=3 et: */
+
+/***********************************************************************
+
+Copyright (c) 2012 Marcus Holland-Moritz
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+***********************************************************************/
+
+#ifndef AIRD_TIME_SERIES_H_
+#define AIRD_TIME_SERIES_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include <time.h>
+
+namespace aird {
+
+/*
+ * CLOCK_BOOTTIME as a std::chrono clock. Unlike steady_clock, it keeps
+ * running while the machine is suspended, so intervals between samples
+ * taken before and after a suspend are real.
+ */
+struct boot_clock
+{
+   typedef std::chrono::nanoseconds duration;
+   typedef duration::rep rep;
+   typedef duration::period period;
+   typedef std::chrono::time_point<boot_clock> time_point;
+
+   static const bool is_steady = true;
+
+   static time_point now()
+   {
+      struct timespec ts;
+      ::clock_gettime(CLOCK_BOOTTIME, &ts);
+      return time_point(std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec));
+   }
+};
+
+/*
+ * Fixed-capacity ring buffer of timestamped samples with one or more
+ * channels. Timestamps and each channel's values live in separate
+ * arrays, so scanning one metric only touches that metric's memory. When
+ * the buffer is full, pushing drops the oldest sample. Index 0 is the
+ * oldest sample, size() - 1 the newest.
+ */
+template <typename T, typename Clock = boot_clock>
+class time_series
+{
+public:
+   typedef Clock clock;
+   typedef typename Clock::time_point time_point;
+
+   explicit time_series(size_t capacity = 0, size_t channels = 1)
+   {
+      reset(capacity, channels);
+   }
+
+   // drops all samples
+   void reset(size_t capacity, size_t channels)
+   {
+      m_capacity = std::max<size_t>(capacity, 1);
+      m_channels = std::max<size_t>(channels, 1);
+      m_head = 0;
+      m_size = 0;
+      m_time.assign(m_capacity, time_point());
+      m_value.assign(m_capacity*m_channels, T());
+   }
+
+   // values must provide one value per channel; timestamps must not go
+   // backwards, older ones are moved up to the newest sample's time
+   template <typename InputIterator>
+   void push(time_point t, InputIterator values)
+   {
+      if (m_size > 0 && t < back_time())
+      {
+         t = back_time();
+      }
+
+      size_t slot;
+
+      if (m_size < m_capacity)
+      {
+         slot = (m_head + m_size++) % m_capacity;
+      }
+      else
+      {
+         slot = m_head;
+         m_head = (m_head + 1) % m_capacity;
+      }
+
+      m_time[slot] = t;
+
+      for (size_t c = 0; c < m_channels; ++c, ++values)
+      {
+         m_value[c*m_capacity + slot] = *values;
+      }
+   }
+
+   void push(time_point t, const T& value)
+   {
+      push(t, &value);
+   }
+
+   bool empty() const
+   {
+      return m_size == 0;
+   }
+
+   size_t size() const
+   {
+      return m_size;
+   }
+
+   size_t capacity() const
+   {
+      return m_capacity;
+   }
+
+   size_t channels() const
+   {
+      return m_channels;
+   }
+
+   time_point time(size_t i) const
+   {
+      return m_time[slot(i)];
+   }
+
+   const T& value(size_t channel, size_t i) const
+   {
+      return m_value[channel*m_capacity + slot(i)];
+   }
+
+   time_point back_time() const
+   {
+      return time(m_size - 1);
+   }
+
+   // index of the first sample not older than t, size() if there is none
+   size_t lower_bound(time_point t) const
+   {
+      size_t lo = 0, hi = m_size;
+
+      while (lo < hi)
+      {
+         size_t mid = lo + (hi - lo)/2;
+
+         if (time(mid) < t)
+         {
+            lo = mid + 1;
+         }
+         else
+         {
+            hi = mid;
+         }
+      }
+
+      return lo;
+   }
+
+   // calls fun(time, value) for every sample of a channel in [from, to]
+   template <typename Function>
+   void for_each(size_t channel, time_point from, time_point to, Function fun) const
+   {
+      for (size_t i = lower_bound(from); i < m_size && time(i) <= to; ++i)
+      {
+         fun(time(i), value(channel, i));
+      }
+   }
+
+private:
+   size_t slot(size_t i) const
+   {
+      return (m_head + i) % m_capacity;
+   }
+
+   std::vector<time_point> m_time;
+   std::vector<T> m_value;
+   size_t m_capacity;
+   size_t m_channels;
+   size_t m_head;
+   size_t m_size;
+};
+
+}
+
+#endif